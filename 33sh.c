@@ -8,18 +8,133 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <stdint.h>
+#include <time.h>
 #include "./jobs.h"
 #include "jobs.c"
-#define INPUT_BUF_LEN 1024
+#include "./reader.h"
+#include "reader.c"
+#include "./pathcache.h"
+#include "pathcache.c"
+#include "./trace.h"
+#include "trace.c"
+#include "./lexer.h"
+#include "lexer.c"
+#include "./runopts.h"
+#include "runopts.c"
+#include "./plancache.h"
+#include "plancache.c"
+#include "./history.h"
+#include "history.c"
+#include "./utilities.h"
+#include "utilities.c"
+#include "./fdcache.h"
+#include "fdcache.c"
 pid_t jpid_shell;
+// The pid of the shell itself, to tell it apart from a child that has not called execv yet.
+pid_t pid_shell;
 job_list_t* job_list;
-int jid = 1;
+line_reader_t* reader;
+path_cache_t* path_cache;
+// Where the lines read by the main loop are parsed into, reused from one line to the next.
+parse_arena_t* arena;
+// The plans of the lines run so far, so that a line that is repeated is not parsed again.
+plan_cache_t* plan_cache;
+// The lines typed so far, kept in $HISTFILE, or ~/.33sh_history if it is not set, across
+// sessions. A script has a history of its own that is not kept.
+history_t* history;
+// The files >> and < redirect to that are kept open, so that a log appended to over and
+// over is not looked up and opened every time. Null while it is off, which it is until the
+// fdcache built-in command turns it on.
+fd_cache_t* fd_cache = NULL;
+// Where a line recalled from the history with ! is put together.
+char* recalled = NULL;
+size_t recalled_cap = 0;
+// Where the body of a here-document is put together while its lines are read.
+char* heredoc = NULL;
+size_t heredoc_cap = 0;
+// The trace the phases of every command are recorded in when the shell is started with
+// -t, null otherwise, in which case timing a phase costs nothing.
+trace_t* trace = NULL;
+// How run_cmd starts commands: LAUNCH_FORK forks and sets the child up by hand before
+// execv, LAUNCH_SPAWN hands the same setup to posix_spawn, which starts the child without
+// copying the shell's address space. Changed with the launcher builtin.
+#define LAUNCH_FORK 0
+#define LAUNCH_SPAWN 1
+int launcher = LAUNCH_FORK;
+// Size in bytes run_cmd asks the kernel to give the pipes between the stages of a pipeline,
+// 0 for the kernel's default. Changed with the pipesize builtin.
+int pipe_size = 0;
+// SIGCHLD is blocked and delivered to sigchld_fd instead, which the main loop waits on with
+// epoll_fd together with stdin and the pidfds of running processes. shell_sigmask is the
+// signal mask the shell started with, which children get back before they run their program.
+// The upper 32 bits of the data of an epoll event say which kind of file descriptor it is
+// for, the lower 32 bits hold the pid for a pidfd and the file descriptor for stdin.
+#define EVENT_STDIN 1
+#define EVENT_SIGCHLD 2
+#define EVENT_PIDFD 3
+#define EVENT_DATA(kind, id) ((uint64_t) (kind) << 32 | (uint32_t) (id))
+int epoll_fd = -1;
+int sigchld_fd = -1;
+sigset_t shell_sigmask;
+// The names of the built-in commands, each at the index that is its id.
+#define BUILTIN_CD 0
+#define BUILTIN_RM 1
+#define BUILTIN_LN 2
+#define BUILTIN_JOBS 3
+#define BUILTIN_HASH 4
+#define BUILTIN_LAUNCHER 5
+#define BUILTIN_PIPESIZE 6
+#define BUILTIN_PARALLEL 7
+#define BUILTIN_EXIT 8
+#define BUILTIN_FG 9
+#define BUILTIN_BG 10
+#define BUILTIN_PLANS 11
+#define BUILTIN_HISTORY 12
+#define BUILTIN_WAIT 13
+#define BUILTIN_FDCACHE 14
+// The common utilities come last, so that their ids index utilities once BUILTIN_ECHO is
+// taken off.
+#define BUILTIN_ECHO 15
+char* builtin_names[] = {"cd", "rm", "ln", "jobs", "hash", "launcher", "pipesize", "parallel",
+  "exit", "fg", "bg", "plans", "history", "wait", "fdcache", "echo", "true", "false", "pwd", "test", "[", "printf",
+  "cat", 0};
+int (*utilities[])(char**) = {utility_echo, utility_true, utility_false, utility_pwd, utility_test,
+  utility_test, utility_printf, utility_cat};
+// The exit status of the last command: that of the last process of a foreground job, 0 for
+// a job started in the background, or what a built-in command returned.
+int last_status = 0;
+// Size of the buffer of stdout.
+#define _OUTPUT_BUF_LEN 65536
+// Set when commands come from a script given with -f rather than from stdin.
+int script_mode = 0;
+// Set when stdin is in the epoll set, which it is not for a script or a regular file.
+int stdin_watched = 0;
+// Set when ^C is typed while the wait built-in command waits, which stops it. SIGINT only
+// reaches the signalfd while wait blocks it, and is ignored the rest of the time.
+int wait_interrupted = 0;
+// Set when stdin is a terminal, in which case the shell does job control: every job gets a
+// process group of its own, foreground jobs are handed the terminal and the shell ignores
+// the signals typed at it, which its children set back. Without a terminal, as when a batch
+// of commands is piped into 33noprompt, none of that does anything, so the jobs stay in the
+// shell's process group and the signals are left as they are, for children to inherit.
+int job_control = 1;
 
 /*
  * This function takes in a string and writes
  * the string in the file corresponding to that file descriptor.
- * I use this function to write error messages in stderr. It then cleans
- * up the job list and exits with flag 1.
+ * I use this function to write error messages in stderr. It then writes
+ * out the lines of the history that are still waiting, cleans up the job
+ * list and exits with flag 1.
  * 
  * err_message - the message to be written in the file corresponding 
  * to the passed in fd.
@@ -27,400 +142,701 @@ int jid = 1;
  */
 void err_and_ex(char* err_message){
   fprintf(stderr, err_message);
+  // A child that failed before execv has a copy of the lines, which are the shell's to write.
+  if (history != NULL && getpid() == pid_shell){
+    flush_history(history);
+  }
   cleanup_job_list(job_list);
   exit(1);
 }
 
 /*
- * This function takes in 3 pointers to arrays storing strings. It 
- * stores strings contained in arg in either cmd_arg or redir_arg.
- * It stores a string (contained in arg) in cmd_arg if the string in the 
- * previous index of arg does not contain a redirection character (> or < or >>).
- * Conversely, it stores a string in redir_arg if it contains a (valid)
- * redirection character or if the string itself does not contain any redirection
- * character but the string in the previous index of arg does.
- * fd - file descriptor of the file err_message is to be written
- * onto
- * arg - pointer to an array of strings. It is from this array of strings
- * that the strings to be stored in cmd_arg or redir_arg are retrieved.
- * cmd_arg - pointer to an array of strings. It is this array strings from
- * arg are stored in if they are not redirection files.
- * redir_arg - pointer to an array of strings. It is this array strings from
- * arg are stored in if either they contain redirection characters or are 
- * redirection files.
- * returns 0 if user has entered a valid command, 1 if the user has entered an invalid 
- * command.
- */
-int parse(char** arg, char** cmd_arg, char** redir_arg){
-  // I use prev_direction_char as a way to distinguish between strings that are stored
-  // right after strings containing redirection characters (redirection files) in cmd 
-  // and those that are not.
-  char prev_direction_char = 0;
-  // A counter which I use to detect multiple instances of the input redirection character
-  // in the same input command. This is illegal and must raise and error accordingly.
-  int redirect_in = 0;
-  // A counter which I use to detect multiple instances of output redirection characters
-  // in the same input command. This is illegal and must raise and error accordingly.
-  int redirect_out = 0;
-  // The index at which I store strings in cmd_arg.
+ * This function copies the word of a token to where the words of a line are kept, null
+ * terminated, for it to be handed to execv.
+ *
+ * arguments: words, where the word goes, which is moved past it. token, the word.
+ *
+ * returns the copy.
+ */
+char* keep_word(char** words, const token_t* token){
+  char* word = *words;
+  memcpy(word, token->start, token->len);
+  word[token->len] = '\0';
+  *words += token->len + 1;
+  return word;
+}
+/*
+ * This function reads the tokens of a line from the lexer, in a single pass, and sorts
+ * them into the pipelines of the line, separated by ;, &, && or ||, and into the words and
+ * the redirections of each stage of every pipeline. The words of a stage go in cmd_arg,
+ * followed by a null pointer, and its redirections in redir_arg, as pairs of the
+ * redirection symbol (<, > or >>) and the file, followed by a null pointer.
+ * A here-document is stored as << and its delimiter, and a here-string as <<< and its
+ * word; either one takes the place of the input file of the stage.
+ * The stages are laid out one after the other, and stage_cmd_args and stage_redir_args
+ * get a pointer to where each one starts, with a null pointer after the last stage of
+ * each pipeline. Each pipeline gets a plan in plans, with its stages, whether it ends with
+ * &, and how it follows the pipeline before it. The line itself is left as it is: only
+ * the words are copied, null terminated, one after the other into copies.
+ * lexer - the lexer reading the line.
+ * cmd_arg, redir_arg, stage_cmd_args, stage_redir_args - arrays of at least n + 2 entries
+ * each for a line of n characters, since every word, redirection, | or separator takes up
+ * at least one character of the line.
+ * copies - at least n + 1 characters, since every word but the last is followed by at least
+ * one character of the line, which its null character takes the place of.
+ * plans - an array of at least n / 2 + 1 plans, since every pipeline but the last is
+ * followed by a separator. Only the fields above are filled in, and nplans in the first.
+ * returns the number of pipelines, 0 if the line is empty, -1 if the user has entered an
+ * invalid command, in which case the reason is printed.
+ */
+int parse(lexer_t* lexer, char** cmd_arg, char** redir_arg, char*** stage_cmd_args,
+    char*** stage_redir_args, char* copies, plan_t* plans){
+  // The symbols put in redir_arg, as the tokens of redirections do not keep their characters.
+  static char redir_in[] = "<";
+  static char redir_out[] = ">";
+  static char redir_append[] = ">>";
+  static char redir_heredoc[] = "<<";
+  static char redir_herestring[] = "<<<";
+  int nplans = 0;
+  // How the pipeline being read follows the one before it.
+  int op = _PLAN_THEN;
+  // Where the stages of the pipeline being read start in stage_cmd_args and stage_redir_args,
+  // and how many of them have ended so far.
+  int first_stage = 0;
+  int nstages = 0;
+  // The index at which I store strings in cmd_arg, and the one for redir_arg.
   int cmd_arg_i = 0;
-  // The index at which I store strings in redir_arg.
   int redir_arg_i = 0;
-  for (int i = 0; arg[i] != 0; i++){
-    // Retrieving the string at the current index of arg.
-    char* string = arg[i];
-    // Retrieving the first character of the string at the current index of arg.
-    char c = string[0];
-    if (c == '>' || c == '<'){
-      // If control flow reaches here, it means the current string is meant to be a redirection
-      // token.
-      if (!prev_direction_char){
-        // If control flow reaches here, then it means there are no successive strings in arg
-        // that are meant to be redirection tokens. This only guarantees that in the command 
-        // entered by the user, there are no two redirection tokens with only whitespace in 
-        // between.
-        if (c == '<'){
-          if (redirect_in){
-            // If control flow reaches here, then it means one of the strings that came before 
-            // the current one in the command line was also < like the current token, which is 
-            // illegal.
-            fprintf(stderr, "syntax error: multiple input files.\n");
-            return 1;               
-          }
-          // If control flow reaches here, then it means the current string is the first instance 
-          // of the < redirection token in the string, in which case the counter is incremented 
-          // accordingly.
-          redirect_in++;
-          } else {
-            if (redirect_out){
-              // If control flow reaches here, then it means one of the strings that came before 
-              // the current one in the command line was also > like the current token, which is 
-              // illegal.
-              fprintf(stderr, "syntax error: multiple output files.\n");
-              return 1;               
-            }
-            // If control flow reaches here, then it means the current string is the first instance 
-            // of the > redirection token in the string, in which case the counter is incremented 
-            // accordingly.
-            redirect_out++;
-          } 
-          if (string[1] == '\0'){
-            // If control flow reaches here, then the current string consists of a single redirection 
-            // character, either '>' or '<', and there is no previous instance of the same redirection 
-            // token in the command line, in which case the prev_direction_char must be set equal to this 
-            // character. Since that the flow reaches here necessarily means that the current string is 
-            // valid, and a redirection token, it is added to redir_arg, whose index is incremented 
-            // accordingly. 
-            prev_direction_char = c;
-            redir_arg[redir_arg_i] = string;
-            redir_arg_i++;
-          } else {
-            // Indicates that the string consists of 2 redirection characters. The only case in which this 
-            // is legal is the string ">>".
-            if (c == '>' && string[1] == '<'){
-              // String >< is illegal. Since > comes first in this case, I interpret this as the error 
-              // that the user has failed to interpret an output file and print the following message 
-              // to stdout.
-              fprintf(stderr, "syntax error: no output file.\n");
-              return 1;
-            } else if (c == '<'){
-              // Strings << and <> are illegal. Since < comes first, I interpret this as a failure 
-              // by the user to specify an input file before the other token. I therefore print the
-              // following message to stdout.
-              fprintf(stderr, "syntax error: no input file.\n");
-              return 1;
-            } 
-            if (string[2] == 0){
-              // Control only reaches here if the user has entered the string ">>" and has not entered > 
-              // before this string which is legal. In this case, I must set prev_direction_char equal to 
-              // ">>", add the current string to redir_arg and increment redir_arg's index accordingly. 
-              prev_direction_char = c;
-              redir_arg[redir_arg_i] = string;
-              redir_arg_i++;
-            } else {
-              // If control reaches here, the string consists of more than 2 redirection characters, 
-              // the first 2 of which are both '>', which is illegal. I interpret this as a failure 
-              // by the user to specify an output file since the first two chars are output redirection 
-              // characters.
-              fprintf(stderr, "syntax error: no output file.\n");
-              return 1;
-            }
-          }
+  // How many words and redirections the current stage has so far. A stage may only have
+  // one input file and one output file.
+  int words = 0;
+  int redirect_in = 0;
+  int redirect_out = 0;
+  // Set once the pipeline being read has anything in it.
+  int empty = 1;
+  stage_cmd_args[0] = cmd_arg;
+  stage_redir_args[0] = redir_arg;
+  token_t token;
+  for (;;){
+    token_type_t type = next_token(lexer, &token);
+    if (type == TOK_WORD){
+      empty = 0;
+      cmd_arg[cmd_arg_i++] = keep_word(&copies, &token);
+      words++;
+    } else if (type == TOK_IN || type == TOK_OUT || type == TOK_APPEND
+        || type == TOK_HEREDOC || type == TOK_HERESTRING){
+      empty = 0;
+      int in = type == TOK_IN || type == TOK_HEREDOC || type == TOK_HERESTRING;
+      if (in ? redirect_in : redirect_out){
+        fprintf(stderr, in ? "syntax error: multiple input files.\n" : "syntax error: multiple output files.\n");
+        return -1;
+      }
+      if (type == TOK_HEREDOC){
+        redir_arg[redir_arg_i++] = redir_heredoc;
+      } else if (type == TOK_HERESTRING){
+        redir_arg[redir_arg_i++] = redir_herestring;
       } else {
-        // If control flow reaches here, then it means there are no successive strings in arg
-        // that are meant to be redirection tokens. This only guarantees that in the command 
-        // entered by the user, there are no two redirection tokens with only whitespace in between.
-        if (prev_direction_char == '>'){
-          fprintf(stderr, "syntax error: no output file.\n");
-          return 1;
-        }
-        fprintf(stderr, "syntax error: no input file.\n");
-        return 1;
+        redir_arg[redir_arg_i++] = in ? redir_in : type == TOK_OUT ? redir_out : redir_append;
       }
-    } else {
-      // The current string does not contain a redirection character. In this case, I use 
-      // prev_direction_char to see if the current word is a redirection file or not.
-      if (!prev_direction_char){
-        // If prev_direction_char is 0, then it means this word does not indicate a redirection 
-        // file and therefore must be a command or an argument to a command, in which case it is 
-        // added to cmd_arg, whose index is then incremented.
-        cmd_arg[cmd_arg_i] = string;
-        cmd_arg_i++;
+      // The redirection symbol must be followed by the file.
+      if (next_token(lexer, &token) != TOK_WORD){
+        fprintf(stderr, in ? "syntax error: no input file.\n" : "syntax error: no output file.\n");
+        return -1;
+      }
+      redir_arg[redir_arg_i++] = keep_word(&copies, &token);
+      if (in){
+        redirect_in = 1;
       } else {
-        // If prev_direction_char is not 0, then it means this word is a redirection file and 
-        // therefore must be added to redir_arg, whose index is incremented. If our current word
-        // is a redirection file, then prev_direction_char must be zeroed for the next words, if 
-        // there are any. If the next word does not consist of redirection characters, then, we 
-        // have necessarily reached a command, which needs prev_redirection_char to be zero to 
-        // be correctly added to cmd_arg. If the next word is a redirection symbol, then it needs 
-        // prev_redirection_char not to incorrectly print error messages and return.
-        redir_arg[redir_arg_i] = string;
-        redir_arg_i++;
-        prev_direction_char = 0;
-      }
-    }
-  }
-  // If the control flow reaches here, then the user did not mess up their redirection symbols, or 
-  // did not forget to specify a file for their first redirection symbol if they entered 2 redirection 
-  // symbols. But the user might have forgot to specify a file for their last (if they have specified 2)
-  // redirection symbol. We also still do not have any guarantee that the user has specified a command.
-
-  // Adding null character to the cap the arrays off.
-  redir_arg[redir_arg_i] = 0;
-  cmd_arg[cmd_arg_i] = 0;
-  // If prev_direction_char is still not null once we are out of our for loop, then it means the last 
-  // non-whitespace character entered by the user was a redirection symbol, in which case the user has
-  // failed to provide the necessary redirection file. 
-  if (prev_direction_char == '>'){
-    // Implies that the user did not specify an output file after > or >>.
-    fprintf(stderr, "syntax error: no output file.\n");
-    return 1;
-  } else if (prev_direction_char == '<'){
-    // Implies that the user did not specify an output file after <.
-    fprintf(stderr, "syntax error: no input file.\n");
-    return 1;
+        redirect_out = 1;
+      }
+    } else if (type == TOK_PIPE){
+      if (!words){
+        fprintf(stderr, "Error- no command.\n");
+        return -1;
+      }
+      // The stage ends here and the next one starts right after it.
+      cmd_arg[cmd_arg_i++] = 0;
+      redir_arg[redir_arg_i++] = 0;
+      nstages++;
+      stage_cmd_args[first_stage + nstages] = &cmd_arg[cmd_arg_i];
+      stage_redir_args[first_stage + nstages] = &redir_arg[redir_arg_i];
+      words = 0;
+      redirect_in = 0;
+      redirect_out = 0;
+    } else if (type == TOK_END && empty){
+      // Nothing after the last separator, which is fine after ; or &, as in a & or a; b;
+      // but not after && or ||, which need a command to run.
+      if (op != _PLAN_THEN){
+        fprintf(stderr, "syntax error: no command after %s.\n", op == _PLAN_AND ? "&&" : "||");
+        return -1;
+      }
+      break;
+    } else {
+      // The end of the line or a separator ends the pipeline, which must have a command,
+      // in its last stage or its only one.
+      if (empty){
+        fprintf(stderr, "syntax error: no command before %s.\n", type == TOK_SEMI ? ";" :
+          type == TOK_AMP ? "&" : type == TOK_AND ? "&&" : "||");
+        return -1;
+      }
+      if (!words){
+        fprintf(stderr, "Error- no command.\n");
+        return -1;
+      }
+      cmd_arg[cmd_arg_i++] = 0;
+      redir_arg[redir_arg_i++] = 0;
+      nstages++;
+      stage_cmd_args[first_stage + nstages] = 0;
+      stage_redir_args[first_stage + nstages] = 0;
+      plans[nplans].nstages = nstages;
+      plans[nplans].background = type == TOK_AMP;
+      plans[nplans].op = op;
+      plans[nplans].cmd_args = &stage_cmd_args[first_stage];
+      plans[nplans].redir_args = &stage_redir_args[first_stage];
+      plans[nplans].paths = NULL;
+      nplans++;
+      if (type == TOK_END){
+        break;
+      }
+      // The next pipeline starts right after the null pointer ending this one.
+      op = type == TOK_AND ? _PLAN_AND : type == TOK_OR ? _PLAN_OR : _PLAN_THEN;
+      first_stage += nstages + 1;
+      nstages = 0;
+      stage_cmd_args[first_stage] = &cmd_arg[cmd_arg_i];
+      stage_redir_args[first_stage] = &redir_arg[redir_arg_i];
+      words = 0;
+      redirect_in = 0;
+      redirect_out = 0;
+      empty = 1;
+    }
   }
-  // Even if the user might not have made any errors in their redirection words/symbols, 
-  // they might still have forgotten to enter a command, in which case I write a "no command"
-  // error message to stdout.
-  if (!cmd_arg_i){
-    fprintf(stderr, "Error- no command.\n");
-    return 1;
+  if (nplans){
+    plans[0].nplans = nplans;
+  }
+  return nplans;
+}
+/*
+ * This function opens a pidfd for a process that was just started and has been added to
+ * the jobs list, and adds it to the epoll set, which reports it readable as soon as the
+ * process terminates. A pidfd keeps referring to the same process even after its pid is
+ * handed out again, so signalling and waiting through it can never hit another process.
+ * Opening it right after starting the process is safe, since the process cannot be reaped,
+ * and its pid reused, before the shell waits for it.
+ *
+ * arguments: pid, the pid of the process.
+ *
+ * returns nothing.
+ */
+void watch_pidfd(pid_t pid){
+  int pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
+  if (pidfd == -1){
+    err_and_ex("pidfd_open failed\n");
+  }
+  if (set_job_pidfd(job_list, pid, pidfd) == -1){
+    close(pidfd);
+    return;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = EVENT_DATA(EVENT_PIDFD, pid);
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pidfd, &event) == -1){
+    err_and_ex("epoll_ctl failed\n");
+  }
+}
+/*
+ * This function takes the pidfd of a process that has been reaped out of the epoll set.
+ * This must happen before the jobs list closes the pidfd, as children that were forked
+ * in the meantime may still hold a copy of it, which would keep it in the set.
+ *
+ * arguments: pid, the pid of the process.
+ *
+ * returns nothing.
+ */
+void unwatch_pidfd(pid_t pid){
+  int pidfd = get_job_pidfd(job_list, pid);
+  if (pidfd != -1){
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pidfd, NULL);
+  }
+}
+/*
+ * This function removes a job from the jobs list, taking the pidfds of the processes of it
+ * that are left out of the epoll set first, so that no event is ever reported for a job
+ * that is gone.
+ *
+ * arguments: jid, the job id of the job.
+ *
+ * returns nothing.
+ */
+void remove_job(int jid){
+  int npidfds = get_job_pidfds(job_list, jid, NULL, 0);
+  if (npidfds > 0){
+    int pidfds[npidfds];
+    get_job_pidfds(job_list, jid, pidfds, npidfds);
+    for (int k = 0; k < npidfds; k++){
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pidfds[k], NULL);
+    }
+  }
+  remove_job_jid(job_list, jid);
+}
+/*
+ * This function is waitid, which also records the resource usage of the child it reports
+ * on in the jobs list, and how it finished if it did. The waitid of the C library leaves
+ * out the last argument of the system call, which returns the same usage wait4 would, so
+ * the system call is made directly. The shell reaps through pidfds, which wait4 cannot
+ * wait on.
+ *
+ * arguments: idtype, id, info and options, as for waitid.
+ *
+ * returns 0 on success, -1 on failure.
+ */
+int wait_child(idtype_t idtype, id_t id, siginfo_t* info, int options){
+  struct rusage usage;
+  if (syscall(SYS_waitid, idtype, id, info, options, &usage) == -1){
+    return -1;
+  }
+  if (info->si_pid){
+    set_job_usage(job_list, info->si_pid, &usage);
+    if (info->si_code == CLD_EXITED){
+      set_job_status(job_list, info->si_pid, info->si_status, 0);
+    } else if (info->si_code == CLD_KILLED || info->si_code == CLD_DUMPED){
+      set_job_status(job_list, info->si_pid, 128 + info->si_status, info->si_status);
+    }
   }
-  // Finally, if the parsing worked correctly, parse returns 0.
   return 0;
 }
 /*
- * This function takes in a pointer to an array of strings, specifically cmd_arg 
- * in the main. Compares the string contained in the first index of cmd_arg, which
- * is necessarily the command, with four built commands, and if there is a match, 
- * executes the command with the corresponding syscall. Also does error handling 
- * of these system calls.
+ * This function waits for a job running in the foreground to finish or stop. A job made
+ * of several processes (a pipeline) has finished once all of them have. Each process is
+ * waited for in turn through its pidfd; when the job is stopped, the process being waited
+ * for stops along with the rest of them. A job that finishes is removed from the jobs
+ * list, silently unless it was terminated by a signal. A job that stops stays in the list,
+ * with its state changed to stopped.
+ *
+ * arguments: jpid, the pid of the job, which is also the id of its process group.
+ *
+ * returns the exit status of the last process of the job, or 128 plus the number of the
+ * signal that terminated or stopped it.
+ */
+int wait_job(pid_t jpid){
+  int job_jid = get_job_jid(job_list, jpid);
+  int status = 0;
+  // Set once a message about a signal has been printed, so that a signal that terminates
+  // every process of a pipeline (like SIGINT from the terminal) is only reported once.
+  int reported = 0;
+  int npidfds = get_job_pidfds(job_list, job_jid, NULL, 0);
+  if (npidfds < 0){
+    return status;
+  }
+  int pidfds[npidfds + 1];
+  get_job_pidfds(job_list, job_jid, pidfds, npidfds);
+  siginfo_t info;
+  for (int k = 0; k < npidfds; k++){
+    if (wait_child(P_PIDFD, (id_t) pidfds[k], &info, WEXITED | WSTOPPED) == -1){
+      if (errno == EINTR){
+        k--;
+        continue;
+      }
+      err_and_ex("wait error!\n");
+    }
+    if (info.si_code == CLD_STOPPED || info.si_code == CLD_TRAPPED){
+      // Foreground job stopped by a signal. The rest of its processes stop as well, which
+      // the reaping in repl notices without printing the message again.
+      if (printf("[%d] (%d) suspended by signal %d\n", job_jid, jpid, info.si_status) < 0){
+        err_and_ex("printf error!\n");
+      }
+      // Process state must be updated. The job is left in the background from now on.
+      update_job_jid(job_list, job_jid, _STATE_STOPPED);
+      set_job_foreground(job_list, job_jid, 0);
+      return 128 + info.si_status;
+    } else if (info.si_code == CLD_KILLED || info.si_code == CLD_DUMPED){
+      // Foreground process terminated by a signal. Writers at the front of a pipeline are
+      // routinely terminated by SIGPIPE when the reader at the end is done, which is not
+      // worth a message.
+      if (info.si_status != SIGPIPE && !reported){
+        reported = 1;
+        if (printf("[%d] (%d) terminated by signal %d\n", job_jid, jpid, info.si_status) < 0){
+          err_and_ex("printf error!\n");
+        }
+      }
+      status = 128 + info.si_status;
+    } else {
+      status = info.si_status;
+    }
+    unwatch_pidfd(info.si_pid);
+    finish_job_process(job_list, info.si_pid);
+  }
+  // Must be removed from jobs list once none of its processes are left.
+  remove_job(job_jid);
+  return status;
+}
+/*
+ * This function looks a command name up among the built-in commands.
+ *
+ * arguments: name, the command name.
+ *
+ * returns the id of the built-in command, or -1 if there is none by that name.
+ */
+int builtin_id(const char* name){
+  for (int id = 0; builtin_names[id] != 0; id++){
+    if (!strcmp(name, builtin_names[id])){
+      return id;
+    }
+  }
+  return -1;
+}
+/*
+ * This function finds the job the argument of fg or bg refers to: %N for job N, %+ or %%
+ * for the job most recently started, stopped or resumed, %- for the one before it, or
+ * %prefix for the job whose command starts with prefix. Without an argument, %+ is meant.
+ * Prints a message if there is no such job or the syntax is wrong.
+ *
+ * arguments: name, fg or bg, for messages. argv, the words of the command.
+ *
+ * returns the pid of the job, or -1 if there is none.
+ */
+pid_t job_spec_pid(const char* name, char** argv){
+  if (argv[1] && argv[2]){
+    // There should not be any more input after the job.
+    fprintf(stderr, "%s: syntax error\n", name);
+    return -1;
+  }
+  if (argv[1] && argv[1][0] != '%'){
+    fprintf(stderr, "syntax error: character must be percentage sign!\n");
+    return -1;
+  }
+  int job_jid = find_job_spec(job_list, argv[1] ? &argv[1][1] : "+");
+  if (job_jid == -2){
+    fprintf(stderr, "%s: %s: ambiguous job spec\n", name, argv[1]);
+    return -1;
+  } else if (job_jid == -1){
+    fprintf(stderr, "job not found\n");
+    return -1;
+  }
+  return get_job_pid(job_list, job_jid);
+}
+/*
+ * This function takes in the id of a built-in command, as found by builtin_id for the
+ * first string of cmd_arg, which is necessarily the command, and a pointer to cmd_arg.
+ * If the id is not -1, executes the command with the corresponding syscall. Also does
+ * error handling of these system calls.
  * 
  * returns 0 in 2 cases: case 1: if there is a match and the
  * corresponding system call is executed successfully. case 2: if there is a match,
  * but the corresponding system call cannot be executed successfully, perhaps due to
- * arguments, in which case we want our program to continue running. Returns 1 if there
- * is no match, because I want my run_cmd to be executed only if there entered command
+ * arguments, in which case we want our program to continue running. Returns 1 if the id
+ * is -1, because I want my run_cmd to be executed only if there entered command
  * is not a built-in command. (I call run_cmd inside a conditional into which flow enters)
  * only if run_built_in_cmd returns 1)
  */
-int run_built_in_cmd(char** argv){
-  if (!strcmp(argv[0], "cd")){
+int run_parallel(char** argv);
+int wait_jobs(char** argv);
+int run_built_in_cmd(int id, char** argv){
+  if (id == BUILTIN_CD){
     if ((chdir(argv[1])) == -1){
       // Error handling chdir().
       fprintf(stderr, "cd: syntax error\n");
+      last_status = 1;
       return 0;
     }
     return 0;
-  } else if (!strcmp(argv[0], "rm")){
+  } else if (id == BUILTIN_RM){
     if ((unlink(argv[1])) == -1){
       // Error handling unlink().
       fprintf(stderr, "rm: syntax error\n");
+      last_status = 1;
       return 0;
     }
     return 0;
-  } else if (!strcmp(argv[0], "ln")){
+  } else if (id == BUILTIN_LN){
     if ((link(argv[1], argv[2])) == -1){
       // Error handling link(), which takes in 2 arguments.
       fprintf(stderr, "cd: syntax error\n");
+      last_status = 1;
       return 0;
     }
     return 0;
-  } else if (!strcmp(argv[0], "jobs")){
-    jobs(job_list);
+  } else if (id == BUILTIN_JOBS){
+    // With -l, also prints how much CPU time, memory, page faults and context switches each
+    // job used, and the jobs that finished last.
+    if (argv[1] && !strcmp(argv[1], "-l")){
+      jobs_long(job_list);
+    } else {
+      jobs(job_list);
+    }
+    return 0;
+  } else if (id == BUILTIN_HASH){
+    // With no arguments, prints the remembered command locations. With -r, forgets them
+    // all. With command names, looks each of them up and remembers where it was found.
+    if (!argv[1]){
+      print_path_cache(path_cache);
+    } else if (!strcmp(argv[1], "-r")){
+      clear_path_cache(path_cache);
+    } else {
+      for (int i = 1; argv[i] != 0; i++){
+        if (resolve_command(path_cache, argv[i]) == NULL){
+          fprintf(stderr, "hash: %s: not found\n", argv[i]);
+        }
+      }
+    }
     return 0;
-  } else if (!strcmp(argv[0], "exit")){
-    // No necessity for error handling exit().
-    // Need to clean job list before exiting.
-    cleanup_job_list(job_list);
-    exit(0);
-  } else if (!strcmp(argv[0], "fg")){
-    // The next string in argv after the command fg must start with %.
-    if (argv[1][0] != '%'){
-      fprintf(stderr, "syntax error: character must be percentage sign!\n");
-      return 0;
+  } else if (id == BUILTIN_PLANS){
+    // With no arguments, prints how many lines were found in the plan cache and how many
+    // had to be parsed. With -r, forgets every plan.
+    if (argv[1] && !strcmp(argv[1], "-r")){
+      clear_plan_cache(plan_cache);
     } else {
-      pid_t jpid;
-      char c;
-      // The second character of the string starting with % must be a integer 
-      // representing jid, else, user has entered illegal syntax.
-      if (!(c = argv[1][1])){
-        fprintf(stderr, "fg: syntax error\n");
-        return 0;
+      print_plan_cache(plan_cache);
+    }
+    return 0;
+  } else if (id == BUILTIN_FDCACHE){
+    // With on, keeps the files >> and < redirect to open from the second time they are
+    // redirected to, with off closes them and stops. With no arguments, prints the files
+    // kept open. With -r, closes and forgets them all.
+    if (!argv[1]){
+      print_fd_cache(fd_cache);
+    } else if (!strcmp(argv[1], "on")){
+      if (fd_cache == NULL && (fd_cache = init_fd_cache()) == NULL){
+        err_and_ex("malloc failed\n");
       }
-      // Checking if the job exists. If it does not, looking for its pid via get_job_pid will
-      // return -1, in which case the following error message is printed.
-      if ((jpid = get_job_pid(job_list, c - 48)) == -1){
-        fprintf(stderr, "job not found\n");
+    } else if (!strcmp(argv[1], "off")){
+      cleanup_fd_cache(fd_cache);
+      fd_cache = NULL;
+    } else if (!strcmp(argv[1], "-r")){
+      clear_fd_cache(fd_cache);
+    } else {
+      fprintf(stderr, "fdcache: must be on, off or -r\n");
+    }
+    return 0;
+  } else if (id == BUILTIN_HISTORY){
+    // With no arguments, prints every line of the history with its number. With a number,
+    // prints only that many of the newest lines. With -s followed by text, prints the lines
+    // containing the text.
+    size_t nlines = count_history(history);
+    size_t from = 0;
+    if (argv[1] && !strcmp(argv[1], "-s")){
+      if (!argv[2]){
+        fprintf(stderr, "history: -s needs text to search for\n");
         return 0;
-      } else {
-        // If user has entered this command, there should not be any more input after %x, where, x
-        // is a jid. If they have, a message indicating illegal syntax is printed.
-        if (argv[2]){
-          fprintf(stderr, "fg: syntax error\n");
-          return 0;
-        } else {
-          // If the control reaches here, then the user has their syntax correct and the job specified
-          // by the passed in jid is in the jobs list, in which case the job is brought to the foreground.
-          int status;
-          if (tcsetpgrp(STDIN_FILENO, jpid) == -1){
-            // Error handling syscall tcsetpgrp.
-            err_and_ex("tcsetpgrp failed\n");
-          }
-          // Paused jobs must be resumed, which is what the conditional below does.
-          if (kill(-jpid, SIGCONT) == -1){
-            // Error handling syscall kill.
-            err_and_ex("kill failed\n");
-          }
-          // Since the job is brought to the foreground, the shell must not do anything else
-          // before it terminates/stops.
-          if (waitpid(jpid, &status, WUNTRACED) == -1){
-            // Error handling syscall waitpid.
-            err_and_ex("waitpid failed\n");
-          } else {
-            if (WIFEXITED(status)){
-              // If the job has ended normally, in which case we come here, it must be removed from
-              // the jobs list, without any message being printed out to the stdout.
-              remove_job_pid(job_list, jpid);
-            } else if (WIFSIGNALED(status)){
-              // Control reaches here if job brought to the fg has terminated due to a signal.
-              if (printf("[%d] (%d) terminated by signal %d\n", get_job_jid(job_list, jpid), jpid, WTERMSIG(status)) < 0){
-                // Error handling syscall printf.
-                err_and_ex("printf failed\n");
-              }
-              // Since terminated by a signal, job must be removed from the jobs list.
-              remove_job_pid(job_list, jpid);
-            } else if (WIFSTOPPED(status)){
-              // The job has stopped.
-              if (printf("[%d] (%d) suspended by signal %d\n", get_job_jid(job_list, jpid), jpid, WSTOPSIG(status)) < 0){
-                // Error handling printf.
-                err_and_ex("printf failed\n");
-              }
-              // Process state must be changed from running to stopped.
-              update_job_jid(job_list, get_job_jid(job_list, jpid), _STATE_STOPPED);
-            }
-          }
+      }
+      // The lines are found newest first, and printed oldest first.
+      size_t* found = malloc(sizeof(size_t) * (nlines ? nlines : 1));
+      if (found == NULL){
+        err_and_ex("malloc failed\n");
+      }
+      size_t nfound = 0;
+      long i = (long) nlines;
+      while ((i = find_history(history, argv[2], strlen(argv[2]), 0, (size_t) i)) != -1){
+        found[nfound++] = (size_t) i;
+      }
+      while (nfound > 0){
+        size_t len;
+        const char* line = get_history(history, found[--nfound], &len);
+        if (printf("%6lu  %.*s\n", found[nfound] + 1, (int) len, line) < 0){
+          err_and_ex("printf error!\n");
         }
       }
-      // command fg successfully executed if we have reached here.
+      free(found);
       return 0;
+    } else if (argv[1]){
+      char* end;
+      unsigned long count = strtoul(argv[1], &end, 10);
+      if (*end || argv[1][0] == '-'){
+        fprintf(stderr, "history: syntax error\n");
+        return 0;
+      }
+      from = count < nlines ? nlines - count : 0;
     }
-  } else if (!strcmp(argv[0], "bg")){
-    // Checking for illegal syntax.
-    if (argv[1][0] != '%'){
-      fprintf(stderr, "syntax error: character must be percentage sign!\n");
-      return 0;
+    for (size_t i = from; i < nlines; i++){
+      size_t len;
+      const char* line = get_history(history, i, &len);
+      if (printf("%6lu  %.*s\n", i + 1, (int) len, line) < 0){
+        err_and_ex("printf error!\n");
+      }
+    }
+    return 0;
+  } else if (id == BUILTIN_WAIT){
+    last_status = wait_jobs(argv);
+    return 0;
+  } else if (id >= BUILTIN_ECHO){
+    // The common utilities, which run without a process of their own. cat leaves reading
+    // from the terminal to the real cat, which ^C can interrupt.
+    int status = utilities[id - BUILTIN_ECHO](argv);
+    if (status == -1){
+      return 1;
+    }
+    last_status = status;
+    return 0;
+  } else if (id == BUILTIN_LAUNCHER){
+    // With no arguments, prints how commands are started. Otherwise switches between
+    // fork and spawn.
+    if (!argv[1]){
+      if (printf("%s\n", launcher == LAUNCH_SPAWN ? "spawn" : "fork") < 0){
+        err_and_ex("printf error!\n");
+      }
+    } else if (!strcmp(argv[1], "fork")){
+      launcher = LAUNCH_FORK;
+    } else if (!strcmp(argv[1], "spawn")){
+      launcher = LAUNCH_SPAWN;
     } else {
-      char c;
-      // The second character of the string starting with % must be a integer 
-      // representing jid, else, user has entered illegal syntax.
-      if (!(c = argv[1][1])){
-        fprintf(stderr, "bg: syntax error\n");
-        return 0;
+      fprintf(stderr, "launcher: must be fork or spawn\n");
+    }
+    return 0;
+  } else if (id == BUILTIN_PIPESIZE){
+    // With no arguments, prints the size pipes are created with. Otherwise sets it, where 0
+    // means the kernel's default. Larger pipes let high-throughput stages move more data
+    // per context switch.
+    if (!argv[1]){
+      if (printf("%d\n", pipe_size) < 0){
+        err_and_ex("printf error!\n");
       }
-      // Is job in the list?
-      pid_t jpid;
-      if ((jpid = (get_job_pid(job_list, c - 48))) == -1){
-        fprintf(stderr, "job not found\n");
-        return 0;
+    } else {
+      char* end;
+      long size = strtol(argv[1], &end, 10);
+      if (*end || size < 0 || size > INT_MAX){
+        fprintf(stderr, "pipesize: syntax error\n");
       } else {
-        if (argv[2]){
-          return 0;
-        } else {
-          if (tcsetpgrp(STDIN_FILENO, jpid_shell) == -1){
-            // Error handling syscall tcsetpgrp
-            err_and_ex("tcsetpgrp failed\n");
-          }
-          // Must resume job if stopped.
-          if (kill(-jpid, SIGCONT) == -1){
-            // Error handling syscall kill.
-            err_and_ex("kill failed\n");
-          }
-        }
+        pipe_size = (int) size;
       }
     }
+    return 0;
+  } else if (id == BUILTIN_PARALLEL){
+    // Defined further down, since it runs the lines it reads like the main loop does. It
+    // fails if any of the lines did, or if it could not run them at all.
+    last_status = run_parallel(argv) != 0;
+    return 0;
+  } else if (id == BUILTIN_EXIT){
+    // No necessity for error handling exit(), but what is still in the output buffer must
+    // make it out. Need to clean job list before exiting.
+    if (fflush(stdout) != 0){
+      err_and_ex("fflush error!\n");
+    }
+    cleanup_path_cache(path_cache);
+    cleanup_parse_arena(arena);
+    cleanup_plan_cache(plan_cache);
+    cleanup_fd_cache(fd_cache);
+    cleanup_history(history);
+    cleanup_job_list(job_list);
+    cleanup_trace(trace);
+    exit(0);
+  } else if (id == BUILTIN_FG){
+    // Finding the job, the current job (%+) by default. If it does not exist, a message has been printed.
+    pid_t jpid = job_spec_pid("fg", argv);
+    if (jpid == -1){
+      return 0;
+    }
+    // If control reaches here, then the user has their syntax correct and the job specified
+    // is in the jobs list, in which case the job is brought to the foreground.
+    if (job_control && tcsetpgrp(STDIN_FILENO, jpid) == -1){
+      // Error handling syscall tcsetpgrp.
+      err_and_ex("tcsetpgrp failed\n");
+    }
+    // Paused jobs must be resumed, which is what the conditional below does. The signal
+    // goes to every process of the job through its pidfd.
+    if (signal_job(job_list, get_job_jid(job_list, jpid), SIGCONT) == -1){
+      // Error handling syscall pidfd_send_signal.
+      err_and_ex("kill failed\n");
+    }
+    update_job_pid(job_list, jpid, _STATE_RUNNING);
+    set_job_foreground(job_list, get_job_jid(job_list, jpid), 1);
+    // Since the job is brought to the foreground, the shell must not do anything else
+    // before it terminates/stops. wait_job removes it from the jobs list if it ends
+    // (printing a message if a signal ended it) and marks it stopped if it stops.
+    last_status = wait_job(jpid);
+    // command fg successfully executed if we have reached here.
+    return 0;
+  } else if (id == BUILTIN_BG){
+    // Is job in the list?
+    pid_t jpid = job_spec_pid("bg", argv);
+    if (jpid == -1){
+      return 0;
+    }
+    if (job_control && tcsetpgrp(STDIN_FILENO, jpid_shell) == -1){
+      // Error handling syscall tcsetpgrp
+      err_and_ex("tcsetpgrp failed\n");
+    }
+    // Must resume job if stopped.
+    if (signal_job(job_list, get_job_jid(job_list, jpid), SIGCONT) == -1){
+      // Error handling syscall pidfd_send_signal.
+      err_and_ex("kill failed\n");
+    }
+    set_job_foreground(job_list, get_job_jid(job_list, jpid), 0);
+    // The job is marked running, and made the current job, once the notification that it
+    // resumed arrives, which is also when the message about it is printed.
     // If control has reached here, then we have successfully executed command bg.
     return 0;
   }
   return 1; 
 }
 /*
- * This function takes in 2 pointers to arrays of strings. Changes the string in the
- * first index of cmd_arg to the last part of that string after the last instance of
- * the char '/' if there is any instances of '/' in the string. Creates a child process
- * by calling fork. Inside the child process, denoted by the conditional (!fork()), changes
- * the string stored at the first index of cmd_arg if it contains '/', stores the full path
- * in a local variable, and then opens files if redir_arg is not empty. 
- * 
- * arguments: cmd_arg and redir_arg.
+ * This function starts one process of a command with fork and execv (a pipeline has one
+ * process per stage). Inside the child process, denoted by the conditional (!pid), puts
+ * the child in its process group, hands it the terminal if it is the first process of a
+ * foreground command, connects it to the pipes on either side of it, changes the string
+ * stored at the first index of cmd_arg to the part after the last '/' if it contains one,
+ * opens files if redir_arg is not empty, restores the default signal handlers and the
+ * original signal mask, applies the settings of a run prefix and replaces itself with the
+ * program at full_path.
  *
- * return value of 0 indicates success, 1 indicates failure.
+ * arguments: full_path, the executable. cmd_arg and redir_arg, the words (without the &)
+ * and redirections of the command. pgid, the process group to put the child in, 0 for a
+ * new group whose id is the child's pid. foreground, whether the command runs in the
+ * foreground. in_fd and out_fd, the pipe ends to use as stdin and stdout, -1 to keep
+ * stdin or stdout as they are; in_fd is the here-document or here-string of the command
+ * instead if it has one. run, the cpus, priorities and limits to launch the program
+ * with, null for none.
+ *
+ * returns the pid of the child.
  */
-
-int run_cmd(char** cmd_arg, char** redir_arg){
+pid_t fork_cmd(const char* full_path, char** cmd_arg, char** redir_arg, pid_t pgid,
+    int foreground, int in_fd, int out_fd, const run_opts_t* run){
+  // When tracing, the child sends the time it started and the time it called execv back
+  // through a close-on-exec pipe, which reads end of file once execv has replaced it. The
+  // shell waits for that before going on, so stages of a pipeline start one after the other.
+  int exec_pipe[2] = {-1, -1};
+  if (trace != NULL && pipe2(exec_pipe, O_CLOEXEC) == -1){
+    err_and_ex("pipe error!\n");
+  }
+  long long fork_start = trace_now(trace);
   pid_t pid = fork();
   if (pid == -1){
     err_and_ex("fork error!\n");
   } else if (!pid){
-    // Creating the child process its own process group ID.
-    if (setpgid(0 , 0) == -1){
+    long long child_start = trace_now(trace);
+    // Putting the child process in the process group of its job. The first process of a job
+    // gets a group of its own, with a process group ID equal to its pid.
+    if (job_control && setpgid(0, pgid) == -1){
       // Error handling syscall setpgid.
       err_and_ex("setpgid failed\n");
     }
-    int i = 0;
-    while (cmd_arg[i] != 0){
-      i++;
-    }
-    // If the user has specified &, and at the correct place of the command (at the end),
-    // that process must be run in the background, which is what I do below.
-    if (*cmd_arg[i - 1] != '&'){
-      // Could have alternatively used pid as pgid, because we assing the child process
-      // a process group id that is equal to its pid.
-      pid_t pgid = getpgid(getpid());
-      if (pgid == -1){
-        err_and_ex("getpgid failed\n");
-      }
-      if (tcsetpgrp(STDIN_FILENO, pgid) == -1){
-        err_and_ex("tcsetpgrp failed\n");
-      }
-    } else {
-      // Otherwise, the process must run in the foreground.
-      if (tcsetpgrp(STDIN_FILENO, jpid_shell) == -1){
+    // If the user has not specified & at the end of the command, the job must run in the
+    // foreground, so its first process hands the terminal over to the job's group, whose
+    // id is its own pid.
+    if (job_control && foreground && !pgid){
+      if (tcsetpgrp(STDIN_FILENO, getpid()) == -1){
         err_and_ex("tcsetpgrp failed\n");
       }
-      cmd_arg[i - 1] = 0;
     }
-    char* full_path = cmd_arg[0];
+    // Connecting the pipes. The original pipe descriptors are close-on-exec, so only the
+    // duplicates on stdin and stdout survive into the program.
+    if (in_fd != -1 && dup2(in_fd, STDIN_FILENO) == -1){
+      err_and_ex("dup2 error!\n");
+    }
+    if (out_fd != -1 && dup2(out_fd, STDOUT_FILENO) == -1){
+      err_and_ex("dup2 error!\n");
+    }
     char* argv_token = strrchr(cmd_arg[0], 47);
     if (argv_token != NULL){
       argv_token = &argv_token[1];
       cmd_arg[0] = argv_token;
     }
     // If the first string in redir_arg is not null, then the user has entered at least one
-    // redirection symbol and one redirection file.
+    // redirection symbol and one redirection file. Redirections win over the pipes.
     if (redir_arg[0] != NULL){
       for (int i = 0; redir_arg[i] != 0; i += 2){
+        // Here-documents and here-strings are already on stdin, as in_fd.
+        if (redir_arg[i][0] == '<' && redir_arg[i][1] == '<'){
+          continue;
+        }
         if (redir_arg[i][0] == '>'){
           // Must assign the file stored in the one index after i of redir_arg the fd of stdout.
           if (close(1) == -1){
@@ -453,16 +869,34 @@ int run_cmd(char** cmd_arg, char** redir_arg){
         }
       }
     }
-    // Must restore the handlers of the following signals.
-    if (signal(SIGINT, SIG_DFL) == SIG_ERR){
-      // Error handling syscall signal.
-      err_and_ex("signal failed\n");
+    // Must restore the handlers of the following signals, which the shell only ignores
+    // when it does job control.
+    if (job_control){
+      if (signal(SIGINT, SIG_DFL) == SIG_ERR){
+        // Error handling syscall signal.
+        err_and_ex("signal failed\n");
+      }
+      if (signal(SIGTSTP, SIG_DFL) == SIG_ERR){
+        err_and_ex("signal failed\n");
+      }
+      if (signal(SIGQUIT, SIG_DFL) == SIG_ERR){
+        err_and_ex("signal failed\n");
+      }
     }
-    if (signal(SIGTSTP, SIG_DFL) == SIG_ERR){
-      err_and_ex("signal failed\n");
+    // The shell keeps SIGCHLD blocked, which must not be passed on to the program.
+    if (sigprocmask(SIG_SETMASK, &shell_sigmask, NULL) == -1){
+      err_and_ex("sigprocmask failed\n");
     }
-    if (signal(SIGQUIT, SIG_DFL) == SIG_ERR){
-      err_and_ex("signal failed\n");
+    // The affinity, priorities and limits are inherited by the program. If they cannot be
+    // applied, the program is not run rather than run without them.
+    if (run != NULL && apply_run_opts(run) == -1){
+      exit(1);
+    }
+    if (exec_pipe[1] != -1){
+      long long times[2] = {child_start, trace_now(trace)};
+      if (write(exec_pipe[1], times, sizeof(times)) == -1){
+        err_and_ex("write error!\n");
+      }
     }
     // Contents of the child's process are replaced by the contents of the process of the program
     // indicated by full_path.
@@ -470,201 +904,1679 @@ int run_cmd(char** cmd_arg, char** redir_arg){
       err_and_ex("execv error!\n");
     }
   }
-  // Checking whether there is an & at the end of the command entered by the user.
-  int j = 0;
-  while (cmd_arg[j] != 0){
-      j++;
+  long long fork_end = trace_now(trace);
+  // The group is also set from this side, so that it exists before the next stage of a
+  // pipeline tries to join it, whichever process gets to run first. This fails harmlessly
+  // if the child has already called execv.
+  if (job_control){
+    setpgid(pid, pgid ? pgid : pid);
   }
-  int wstatus;
-  if (*cmd_arg[j - 1] != '&'){
-    // Must only wait for foreground processes.
-    if (waitpid(pid, &wstatus, WUNTRACED) == -1){
-      err_and_ex("wait error!\n");
-    } else if (WIFSIGNALED(wstatus)){
-      // Foreground process terminated by a signal.
-      if (printf("[%d] (%d) terminated by signal %d\n", jid, pid, WTERMSIG(wstatus)) < 0){
-        err_and_ex("printf error!\n");
-      }
-      // Must be removed from jobs list.
-      remove_job_pid(job_list, pid);
-    } else if (WIFSTOPPED(wstatus)){
-      // Foreground process stopped by a signal.
-      if (printf("[%d] (%d) suspended by signal %d\n", jid, pid, WSTOPSIG(wstatus)) < 0){
-        err_and_ex("printf error!\n");
-      }
-      // Process state must be updated and added to jobs list.
-      add_job(job_list, jid, pid, _STATE_STOPPED, cmd_arg[0]);
-      jid++;
-    } else if (WIFCONTINUED(wstatus)){
-      if (printf("[%d] (%d) resumed\n", jid, pid) < 0){
-        err_and_ex("printf error!\n");
-      }
-      // Process state must be updated.
-      update_job_jid(job_list, get_job_jid(job_list, pid), _STATE_RUNNING);
-    }
-  } else {
-    // Background processes must be added to jobs list right away.
-    add_job(job_list, jid, pid, _STATE_RUNNING, cmd_arg[0]);
-    if (printf("[%d] (%d)\n", jid, pid) < 0){
-      err_and_ex("printf error!\n");
+  trace_span(trace, "fork", 0, fork_start, fork_end, cmd_arg[0]);
+  if (exec_pipe[0] != -1){
+    close(exec_pipe[1]);
+    long long times[2];
+    ssize_t got = read(exec_pipe[0], times, sizeof(times));
+    // Waiting for the end of file, which comes once execv succeeded or the child exited.
+    char c;
+    ssize_t n;
+    while ((n = read(exec_pipe[0], &c, 1)) > 0 || (n == -1 && errno == EINTR));
+    long long exec_end = trace_now(trace);
+    close(exec_pipe[0]);
+    if (got == sizeof(times)){
+      trace_span(trace, "child setup", pid, times[0], times[1], cmd_arg[0]);
+      trace_span(trace, "exec", pid, times[1], exec_end, cmd_arg[0]);
     }
-    jid++;
-  }
-  // Must restore control back to the shell before returning.
-  if (tcsetpgrp(STDIN_FILENO, jpid_shell) == -1){
-    err_and_ex("tcsetgprg failed\n");
   }
-  return 0;
+  return pid;
 }
 /*
- * My implementation of REPL. Prints a prompt on stdout if the macro PROMPT
- * is defined. Reads command from stdin, parses the command, either performs built-in
- * commands or commands that are not built in.
- * 
- * arguments: no arguments
+ * This function starts one process of a command with posix_spawn instead of fork and
+ * execv. Everything fork_cmd sets up by hand in the child is expressed as spawn attributes
+ * and file actions instead: the process group, the terminal handed to that group if the
+ * command runs in the foreground, the pipes and the redirections in redir_arg put in
+ * place of stdin/stdout, SIGINT, SIGTSTP and SIGQUIT set back to their default handlers
+ * and the shell's original signal mask. Since glibc implements posix_spawn with
+ * clone(CLONE_VM|CLONE_VFORK), none of the shell's memory is copied, which keeps starting
+ * a command cheap however large the shell grows.
  *
- * returns 1 upon success.
+ * arguments: the same as fork_cmd. cmd_arg is left untouched.
+ *
+ * returns the pid of the child, or -1 if it could not be started.
  */
-int repl(){
-  pid_t pid;
-  int wstatus;
-  // Reaping.
-  while ((pid = waitpid(-1, &wstatus, WNOHANG|WUNTRACED|WCONTINUED)) > 0){
-    if (WIFEXITED(wstatus)){
-      if (printf("[%d] (%d) terminated with exit status %d\n", get_job_jid(job_list, pid), pid, WEXITSTATUS(wstatus)) < 0){
-        err_and_ex("printf error!\n");
-      }
-      remove_job_pid(job_list, pid);
-    } else if (WIFSIGNALED(wstatus)){
-      if (printf("[%d] (%d) terminated by signal %d\n", get_job_jid(job_list, pid), pid, WTERMSIG(wstatus)) < 0){
-        err_and_ex("printf error!\n");
-      }
-      remove_job_pid(job_list, pid);
-    } else if (WIFSTOPPED(wstatus)){
-      if (printf("[%d] (%d) suspended by signal %d\n", get_job_jid(job_list, pid), pid, WSTOPSIG(wstatus)) < 0){
-        err_and_ex("printf error!\n");
-      }
-      update_job_jid(job_list, get_job_jid(job_list, pid), _STATE_STOPPED);
-    } else if (WIFCONTINUED(wstatus)){
-      if (printf("[%d] (%d) resumed\n", get_job_jid(job_list, pid), pid) < 0){
-        err_and_ex("printf error!\n");
-      }
-      if (fflush(stdout) != 0){
-        err_and_ex("fflush error!\n");
-      }
-      update_job_jid(job_list, get_job_jid(job_list, pid), _STATE_RUNNING);
-    } 
+pid_t spawn_cmd(const char* full_path, char** cmd_arg, char** redir_arg, pid_t pgid,
+    int foreground, int in_fd, int out_fd){
+  int n = 0;
+  while (cmd_arg[n] != 0){
+    n++;
   }
-  // Error handling waitpid.
-  if (job_list->head != NULL){
-    if (pid == -1){
-      err_and_ex("waitpid error!\n");
+  // The child gets its own copy of argv with only the last part of the command's path, as
+  // fork_cmd does in the child.
+  char* argv[n + 1];
+  for (int i = 0; i <= n; i++){
+    argv[i] = cmd_arg[i];
+  }
+  char* argv_token = strrchr(argv[0], '/');
+  if (argv_token != NULL){
+    argv[0] = &argv_token[1];
+  }
+
+  posix_spawnattr_t attr;
+  posix_spawn_file_actions_t actions;
+  if (posix_spawnattr_init(&attr) || posix_spawn_file_actions_init(&actions)){
+    err_and_ex("posix_spawn init failed\n");
+  }
+  // The shell keeps SIGCHLD blocked, which must not be passed on to the program.
+  posix_spawnattr_setsigmask(&attr, &shell_sigmask);
+  short flags = POSIX_SPAWN_SETSIGMASK;
+  if (job_control){
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTSTP);
+    sigaddset(&defaults, SIGQUIT);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    // Process group 0 gives the child a new group with the same id as its pid.
+    posix_spawnattr_setpgroup(&attr, pgid);
+    flags |= POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF;
+  }
+  posix_spawnattr_setflags(&attr, flags);
+  #if __GLIBC_PREREQ(2, 35)
+  // Handing the terminal over must happen before stdin is redirected away from it.
+  if (job_control && foreground && !pgid){
+    posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+  }
+  #endif
+  if (in_fd != -1){
+    posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+  }
+  if (out_fd != -1){
+    posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+  }
+  for (int i = 0; redir_arg[i] != 0; i += 2){
+    if (redir_arg[i][0] == '<' && redir_arg[i][1] == '<'){
+      continue;
+    }
+    if (redir_arg[i][0] == '>'){
+      // > truncates the output file, >> appends to it.
+      int flags = O_CREAT | O_WRONLY | (redir_arg[i][1] ? O_APPEND : O_TRUNC);
+      posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, redir_arg[i + 1], flags, 0666);
+    } else {
+      posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, redir_arg[i + 1], O_RDONLY, 0666);
     }
   }
-  #ifdef PROMPT
-  if (printf("33sh> ") < 0){
-    err_and_ex("printf error!\n");
+
+  pid_t pid;
+  long long spawn_start = trace_now(trace);
+  int err = posix_spawn(&pid, full_path, &actions, &attr, argv, environ);
+  // posix_spawn only returns once the child has called exec, so this covers the exec too.
+  trace_span(trace, "spawn", 0, spawn_start, trace_now(trace), cmd_arg[0]);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  if (err){
+    fprintf(stderr, "%s: %s\n", cmd_arg[0], strerror(err));
+    return -1;
   }
-  // Need fflush(stdout) since there is no new line at the end of the prompt.
-  if (fflush(stdout) != 0){
-    err_and_ex("fflush error!\n");
+  #if !__GLIBC_PREREQ(2, 35)
+  // Without the file action, the terminal can only be handed over from this side.
+  if (job_control && foreground && !pgid && tcsetpgrp(STDIN_FILENO, pid) == -1){
+    err_and_ex("tcsetpgrp failed\n");
   }
   #endif
-  char p[INPUT_BUF_LEN];
-  ssize_t input_len = read(STDIN_FILENO, p, INPUT_BUF_LEN);
-  // If there is an error executing read, -1 is returned to input_len, in which case
-  // the program must exit() with 1 passed to exit to indicate error.
-  if (input_len < 0){
-    // Error handling read()
-    err_and_ex("read error!\n");
-  } else if (input_len == 1){
-    // If user presses enter, must return (returns 0 since this is not an error)
-    // because we want our prompt to still be displayed and our program to continue
-    // running.
-    return 0;
-  } else if (input_len == 0){
-    cleanup_job_list(job_list);
-    exit(0);
-  } else {
-    // In any other cases, our repl should function as desired. Since the user finishes
-    // entering command by pressing enter, a newline is added to the end of our buffer,
-    // which we replace with the null character below.
-    p[input_len - 1] = 0;
-    int i = 0;
-    // I use strtok to get rid of all whitespace in the command words entered by the user
-    // which I store in my buffer.
-    char* arg[input_len];
-    char* token;
-    token = strtok(p, " \t\n");
-    arg[i] = token;
-    i++;
-    while (token != NULL){
-      token = strtok(NULL, " \t\n");
-      arg[i] = token;
-      i++;
-    }
-    if (i == 1){
-      return 0;
+  return pid;
+}
+/*
+ * This function serves the redirections of a command from the redirection cache. A >> or a
+ * < is served if it is the only redirection of stdout or stdin of the command, so that
+ * which redirection wins stays the same, and the cache has a descriptor for its file: the
+ * descriptor goes in out_fd or in_fd, for the child to dup2 like a pipe end, and the
+ * redirection is left out of kept. Every other redirection is copied into kept.
+ *
+ * arguments: redir_arg, the redirections of the command. kept, as long as redir_arg. in_fd
+ * and out_fd, set to the descriptors of the cache, left as they are otherwise.
+ */
+void take_cached_redirs(char** redir_arg, char** kept, int* in_fd, int* out_fd){
+  int n_in = 0;
+  int n_out = 0;
+  for (int i = 0; redir_arg[i] != 0; i += 2){
+    if (redir_arg[i][0] == '<'){
+      n_in++;
+    } else {
+      n_out++;
     }
-    // I add this 0 for my loops in other functions. (I stop executing these loops when I reach
-    // the null character in arg)
-    arg[i] = 0;
-    char* cmd_arg[input_len];
-    char* redir_arg[input_len];
-    // If parse is successful, meaning the command entered by the user is valid, parse returns 0,
-    // in which case we want to execute the commands specified by the user. If not, we want to
-    // print the necessary error message to stdout and start from the beginning.
-    if (!parse(arg, cmd_arg, redir_arg)){
-      // If the user enters a built-in command, it is executed, and 0 is returned because we do not want
-      // run_cmd to be executed if a built-in command is executed.
-      if (run_built_in_cmd(cmd_arg)){
-        run_cmd(cmd_arg, redir_arg);
+  }
+  int k = 0;
+  for (int i = 0; redir_arg[i] != 0; i += 2){
+    int fd = -1;
+    if (redir_arg[i][0] == '>' && redir_arg[i][1] && n_out == 1){
+      if ((fd = get_redir_fd(fd_cache, redir_arg[i + 1], 1)) != -1){
+        *out_fd = fd;
       }
-      if (tcsetpgrp(STDIN_FILENO, jpid_shell) == -1){
-        err_and_ex("tcsetgprg failed\n");
+    } else if (redir_arg[i][0] == '<' && !redir_arg[i][1] && n_in == 1){
+      if ((fd = get_redir_fd(fd_cache, redir_arg[i + 1], 0)) != -1){
+        *in_fd = fd;
       }
     }
+    if (fd == -1){
+      kept[k++] = redir_arg[i];
+      kept[k++] = redir_arg[i + 1];
+    }
   }
-  // Clearing memory to avoid data left over from one read call from messing up data from the current 
-  // read call.
-  memset(p, 0, INPUT_BUF_LEN);
-  return 0;
+  kept[k] = 0;
 }
 /*
- * My main method
- * 
- * arguments: no arguments
+ * This function takes in 2 arrays of pointers to arrays of strings, holding the words and
+ * the redirections of each stage of a pipeline; a plain command is a pipeline with a single
+ * stage. Both arrays end with a null pointer. Looks each command up in PATH (through the
+ * location cache) if it does not contain a '/', connects every stage to the next one with
+ * a pipe and starts every stage with fork_cmd, or spawn_cmd if the launcher is spawn. All
+ * the stages go in one process group and are added to the jobs list as one job, under the
+ * lowest job id no other job has, without waiting for it.
  *
- * returns 0.
+ * arguments: cmd_args and redir_args, without the &. foreground, whether the job gets
+ * the terminal. run, the settings of a run prefix, which every process of the job is
+ * launched with and which are recorded on the job, or null. input_fds, for each stage, the
+ * file holding its here-document or here-string, which it gets as stdin in place of the
+ * pipe, or -1; null if no stage has one. They are left open. paths, for a plan from the
+ * plan cache, where the command of each stage was found, which is filled in for the stages
+ * not looked up yet; null otherwise.
+ *
+ * returns the pid of the job, or 0 if nothing could be started.
  */
-int main(){
-  //Initializing jobs list.
-  job_list = init_job_list();
+pid_t start_job(char*** cmd_args, char*** redir_args, int foreground, const run_opts_t* run,
+    const int* input_fds, char** paths){
+  if (run != NULL && !run->flags){
+    run = NULL;
+  }
+  // Whatever is in the output buffer must go out before the job can print anything, and
+  // before forking, or the child would have a copy of it to flush as well.
+  if (fflush(stdout) != 0){
+    err_and_ex("fflush error!\n");
+  }
+  int nstages = 0;
+  while (cmd_args[nstages] != 0){
+    nstages++;
+  }
+  // The commands are looked up before forking, so that the locations found are remembered
+  // by the shell and the next run of the same command does not have to search PATH again.
+  // Looking them all up first means nothing is started if any of them does not exist. A
+  // plan from the cache keeps the locations, so that running its line again does not look
+  // anything up at all.
+  long long resolve_start = trace_now(trace);
+  for (int i = 0; i < nstages; i++){
+    if (paths != NULL && paths[i] != NULL){
+      continue;
+    }
+    const char* found = resolve_command(path_cache, cmd_args[i][0]);
+    if (found == NULL){
+      fprintf(stderr, "%s: command not found\n", cmd_args[i][0]);
+      return 0;
+    }
+    if (paths != NULL){
+      paths[i] = strdup(found);
+    }
+  }
+  trace_span(trace, "resolve", 0, resolve_start, trace_now(trace), cmd_args[0][0]);
+  // The job's pid is the pid of its first process, which is also its process group ID.
+  pid_t jpid = 0;
+  int job_jid = -1;
+  // The read end of the pipe from the previous stage.
+  int in_fd = -1;
+  for (int i = 0; i < nstages; i++){
+    int fds[2] = {-1, -1};
+    if (i < nstages - 1){
+      // The pipe is close-on-exec so that the only copies any program ends up with are the
+      // ones its stage puts on stdin and stdout, otherwise readers would never see EOF.
+      if (pipe2(fds, O_CLOEXEC) == -1){
+        err_and_ex("pipe error!\n");
+      }
+      if (pipe_size > 0){
+        // Only a hint, the kernel may refuse sizes above its limit.
+        fcntl(fds[1], F_SETPIPE_SZ, pipe_size);
+      }
+    }
+    // Already found above, so this comes straight from the cache. It is looked up again
+    // because a path from the cache is only valid until the next lookup.
+    const char* full_path = paths != NULL && paths[i] != NULL ? paths[i]
+      : resolve_command(path_cache, cmd_args[i][0]);
+    // Like any redirection, a here-document wins over the pipe from the previous stage.
+    int stage_in = input_fds != NULL && input_fds[i] != -1 ? input_fds[i] : in_fd;
+    int stage_out = fds[1];
+    // The files the cache has open are handed over like the pipes, and so win over them
+    // too, in place of the redirections that would open them.
+    int nredirs = 0;
+    while (redir_args[i][nredirs] != 0){
+      nredirs++;
+    }
+    char* kept[nredirs + 1];
+    char** stage_redir = redir_args[i];
+    int cached_in = -1;
+    if (fd_cache != NULL && nredirs){
+      take_cached_redirs(redir_args[i], kept, &cached_in, &stage_out);
+      stage_redir = kept;
+      if (cached_in != -1){
+        stage_in = cached_in;
+      }
+    }
+    pid_t pid = -1;
+    if (full_path == NULL){
+      fprintf(stderr, "%s: command not found\n", cmd_args[i][0]);
+    } else if (launcher == LAUNCH_SPAWN && run == NULL){
+      pid = spawn_cmd(full_path, cmd_args[i], stage_redir, jpid, foreground, stage_in, stage_out);
+    } else {
+      // posix_spawn has no attributes for the settings of run, which the child applies
+      // itself.
+      pid = fork_cmd(full_path, cmd_args[i], stage_redir, jpid, foreground, stage_in, stage_out, run);
+    }
+    // The offset of a file read is shared with the child, so the cache must not hand the
+    // same descriptor out again while it reads.
+    if (pid != -1 && cached_in != -1){
+      set_redir_fd_user(fd_cache, cached_in, pid);
+    }
+    // The children have their own copies of the pipe ends now.
+    if (in_fd != -1){
+      close(in_fd);
+    }
+    if (fds[1] != -1){
+      close(fds[1]);
+    }
+    in_fd = fds[0];
+    if (pid == -1){
+      // The stage could not be started. The stages next to it see end of file or a broken
+      // pipe, just as if it had exited right away.
+      continue;
+    }
+    // The job is added to the jobs list right away, even in the foreground, so that its
+    // processes can be told apart from the others while it is waited for.
+    if (!jpid){
+      jpid = pid;
+      job_jid = get_free_jid(job_list);
+      add_job(job_list, job_jid, pid, _STATE_RUNNING, cmd_args[0][0]);
+      set_job_foreground(job_list, job_jid, foreground);
+      if (run != NULL){
+        char launch[_RUN_DESC_LEN];
+        format_run_opts(run, launch, sizeof(launch));
+        set_job_launch(job_list, job_jid, launch);
+      }
+    } else {
+      add_job_process(job_list, job_jid, pid);
+    }
+    watch_pidfd(pid);
+  }
+  return jpid;
+}
+/*
+ * This function takes in 2 arrays of pointers to arrays of strings, holding the words and
+ * the redirections of each stage of a pipeline; a plain command is a pipeline with a single
+ * stage. Both arrays end with a null pointer. Starts the pipeline as a job with start_job
+ * and waits for the job if it runs in the foreground.
+ * 
+ * arguments: cmd_args and redir_args. background, whether the line ended with &. run,
+ * input_fds and paths, as for start_job.
+ *
+ * return value of 0 indicates success, 1 indicates failure.
+ */
+int run_cmd(char*** cmd_args, char*** redir_args, int background, const run_opts_t* run,
+    const int* input_fds, char** paths){
+  pid_t jpid = start_job(cmd_args, redir_args, !background, run, input_fds, paths);
+  if (!jpid){
+    // Nothing was started.
+    last_status = 1;
+    return 1;
+  }
+  last_status = 0;
+  if (!background){
+    // Must only wait for foreground processes. The job is still in the list if it was
+    // stopped, in which case it keeps its job id.
+    long long wait_start = trace_now(trace);
+    last_status = wait_job(jpid);
+    trace_span(trace, "wait", 0, wait_start, trace_now(trace), cmd_args[0][0]);
+  } else {
+    if (printf("[%d] (%d)\n", get_job_jid(job_list, jpid), jpid) < 0){
+      err_and_ex("printf error!\n");
+    }
+  }
+  // Must restore control back to the shell before returning.
+  if (job_control){
+    long long tcsetpgrp_start = trace_now(trace);
+    if (tcsetpgrp(STDIN_FILENO, jpid_shell) == -1){
+      err_and_ex("tcsetgprg failed\n");
+    }
+    trace_span(trace, "tcsetpgrp", 0, tcsetpgrp_start, trace_now(trace), NULL);
+  }
+  return 0;
+}
+/*
+ * This function updates the jobs list for a child process that was reaped, stopped or
+ * resumed and prints a message about its job if the job changed. A pipeline is only
+ * reported as terminated once all of its processes are, and as stopped or resumed for
+ * the first of its processes that is.
+ *
+ * arguments: info, what waitid reported about the child.
+ *
+ * returns the number of messages printed.
+ */
+int report_child(siginfo_t* info){
+  // The messages are about jobs, so they carry the pid of the job, which for a pipeline is
+  // the pid of its first process rather than of the process that changed.
+  pid_t pid = info->si_pid;
+  int job_jid = get_job_jid(job_list, pid);
+  pid_t job_pid = job_jid == -1 ? pid : get_job_pid(job_list, job_jid);
+  if (info->si_code == CLD_EXITED || info->si_code == CLD_KILLED || info->si_code == CLD_DUMPED){
+    unwatch_pidfd(pid);
+    if (finish_job_process(job_list, pid) > 0){
+      return 0;
+    }
+    if (info->si_code == CLD_EXITED){
+      if (printf("[%d] (%d) terminated with exit status %d\n", job_jid, job_pid, info->si_status) < 0){
+        err_and_ex("printf error!\n");
+      }
+    } else if (printf("[%d] (%d) terminated by signal %d\n", job_jid, job_pid, info->si_status) < 0){
+      err_and_ex("printf error!\n");
+    }
+    remove_job(job_jid);
+    return 1;
+  } else if (info->si_code == CLD_STOPPED || info->si_code == CLD_TRAPPED){
+    if (get_job_state(job_list, job_jid) != NULL && strcmp(get_job_state(job_list, job_jid), _STATE_STOPPED)){
+      if (printf("[%d] (%d) suspended by signal %d\n", job_jid, job_pid, info->si_status) < 0){
+        err_and_ex("printf error!\n");
+      }
+      update_job_jid(job_list, job_jid, _STATE_STOPPED);
+      return 1;
+    }
+  } else if (info->si_code == CLD_CONTINUED){
+    if (get_job_state(job_list, job_jid) != NULL && strcmp(get_job_state(job_list, job_jid), _STATE_RUNNING)){
+      if (printf("[%d] (%d) resumed\n", job_jid, job_pid) < 0){
+        err_and_ex("printf error!\n");
+      }
+      update_job_jid(job_list, job_jid, _STATE_RUNNING);
+      return 1;
+    }
+  }
+  return 0;
+}
+/*
+ * This function collects the stop and resume notifications of every child that stopped
+ * or resumed since it was last called, without waiting for any. It is the only place the
+ * shell waits on any child rather than on a particular one, and it never reaps a process
+ * (terminated processes are reaped through their pidfds), so no pid is ever freed for
+ * reuse behind the back of the jobs list.
+ *
+ * arguments: no arguments
+ *
+ * returns the number of messages printed.
+ */
+int reap_stopped(){
+  int printed = 0;
+  siginfo_t info;
+  for (;;){
+    info.si_pid = 0;
+    if (wait_child(P_ALL, 0, &info, WSTOPPED | WCONTINUED | WNOHANG) == -1){
+      if (errno == ECHILD){
+        // No children at all.
+        break;
+      }
+      err_and_ex("waitid error!\n");
+    }
+    if (!info.si_pid){
+      break;
+    }
+    printed += report_child(&info);
+  }
+  return printed;
+}
+/*
+ * This function handles the events epoll_wait returned for the pidfds of running processes
+ * and for the SIGCHLD signalfd. A readable pidfd means its process has terminated, and it is
+ * reaped through the pidfd. SIGCHLD means a child has stopped or resumed (or terminated,
+ * which its pidfd reports as well). Events for stdin are left to the caller. An event for
+ * a process that was reaped since epoll_wait returned, by an earlier event or by a wait
+ * on its job, is skipped.
+ *
+ * arguments: events and n, the events and how many there are.
+ *
+ * returns the number of messages printed.
+ */
+int handle_events(struct epoll_event* events, int n){
+  int printed = 0;
+  for (int k = 0; k < n; k++){
+    uint64_t kind = events[k].data.u64 >> 32;
+    if (kind == EVENT_PIDFD){
+      pid_t pid = (pid_t) (uint32_t) events[k].data.u64;
+      int pidfd = get_job_pidfd(job_list, pid);
+      if (pidfd == -1){
+        continue;
+      }
+      siginfo_t info;
+      info.si_pid = 0;
+      if (wait_child(P_PIDFD, (id_t) pidfd, &info, WEXITED | WNOHANG) == -1){
+        if (errno == ECHILD || errno == EBADF){
+          continue;
+        }
+        err_and_ex("waitid error!\n");
+      }
+      if (info.si_pid){
+        printed += report_child(&info);
+      }
+    } else if (kind == EVENT_SIGCHLD){
+      // Draining the signalfd. Several SIGCHLDs may have been merged into one, which does
+      // not matter since reap_stopped collects every child that changed.
+      struct signalfd_siginfo siginfo;
+      while (read(sigchld_fd, &siginfo, sizeof(siginfo)) == sizeof(siginfo)){
+        if (siginfo.ssi_signo == SIGINT){
+          wait_interrupted = 1;
+        }
+      }
+      printed += reap_stopped();
+    }
+  }
+  return printed;
+}
+/*
+ * This function reaps every child process that has terminated, stopped or resumed since
+ * it was last called, without waiting for any, updates the jobs list accordingly and
+ * prints a message about every job that changed.
+ *
+ * arguments: no arguments
+ *
+ * returns the number of messages printed.
+ */
+int reap_jobs(){
+  int printed = 0;
+  struct epoll_event events[64];
+  int n;
+  // Polling the epoll set without waiting, as many times as it takes to see every event.
+  do {
+    if ((n = epoll_wait(epoll_fd, events, 64, 0)) == -1){
+      err_and_ex("epoll_wait error!\n");
+    }
+    printed += handle_events(events, n);
+  } while (n == 64);
+  // The messages stay in the output buffer until the prompt is printed.
+  return printed;
+}
+/*
+ * This function is the wait built-in command. It waits for jobs running in the background
+ * to finish: every one of them without arguments, the ones given as job specs (%N, %+,
+ * %-, %prefix) otherwise, or with -n only until any one of those finishes, so that a
+ * script can keep a bounded number of jobs going. It sleeps in epoll_wait on the pidfds of
+ * their processes and on the SIGCHLD signalfd, and reaps and reports jobs through
+ * handle_events, as the shell does between commands, so the jobs list and the messages are
+ * the same. Stopped jobs are not waited for, since nothing would resume them. A job that
+ * already finished, and was reaped before wait ran, is looked up among the jobs that
+ * finished most recently, and has the status it finished with. ^C stops the waiting.
+ *
+ * arguments: argv, the words of the command.
+ *
+ * returns the exit status of the last job given, or of the job that finished first with
+ * -n, 0 when waiting for every job, 127 for a job that does not exist or when there was
+ * nothing to wait for with -n, 130 if interrupted.
+ */
+int wait_jobs(char** argv){
+  int any = argv[1] != NULL && !strcmp(argv[1], "-n");
+  char** specs = &argv[any ? 2 : 1];
+  // Whatever already finished is reaped first.
+  reap_jobs();
+  // The job ids waited for, -1 for specs that matched no job or a job that already
+  // finished, whose status is kept in done, -1 for the others.
+  int njids = 0;
+  while (specs[njids] != NULL){
+    njids++;
+  }
+  if (njids == 0){
+    njids = get_job_jids(job_list, NULL, 0);
+  }
+  int jids[njids + 1];
+  int done[njids + 1];
+  int first_done = -1;
+  if (specs[0] != NULL){
+    for (int i = 0; i < njids; i++){
+      jids[i] = specs[i][0] == '%' ? find_job_spec(job_list, &specs[i][1]) : -1;
+      done[i] = -1;
+      if (jids[i] == -2){
+        fprintf(stderr, "wait: %s: ambiguous job spec\n", specs[i]);
+        jids[i] = -1;
+      } else if (jids[i] == -1 && specs[i][0] == '%'
+          && find_done_job_spec(job_list, &specs[i][1], &done[i]) != -1){
+        if (first_done == -1){
+          first_done = i;
+        }
+      } else if (jids[i] == -1){
+        fprintf(stderr, "wait: %s: no such job\n", specs[i]);
+      }
+    }
+    // With -n, a job that has already finished is the first one to.
+    if (any && first_done != -1){
+      return done[first_done];
+    }
+  } else {
+    // Taken all at once, since jobs leave the list while they are waited for.
+    get_job_jids(job_list, jids, njids);
+  }
+  // Stdin stays readable while it is not read, so it is taken out of the epoll set, and
+  // SIGINT is blocked so that ^C is seen on the signalfd instead of being ignored.
+  struct epoll_event event;
+  event.events = 0;
+  event.data.u64 = EVENT_DATA(EVENT_STDIN, STDIN_FILENO);
+  if (stdin_watched && epoll_ctl(epoll_fd, EPOLL_CTL_MOD, STDIN_FILENO, &event) == -1){
+    err_and_ex("epoll_ctl failed\n");
+  }
+  sigset_t sigint;
+  sigemptyset(&sigint);
+  sigaddset(&sigint, SIGINT);
+  if (job_control && sigprocmask(SIG_BLOCK, &sigint, NULL) == -1){
+    err_and_ex("sigprocmask failed\n");
+  }
+  wait_interrupted = 0;
+  int finished = -1;
+  for (;;){
+    int running = 0;
+    for (int i = 0; i < njids; i++){
+      process_state_t state = jids[i] == -1 ? NULL : get_job_state(job_list, jids[i]);
+      if (state != NULL && !strcmp(state, _STATE_RUNNING)){
+        running++;
+      }
+    }
+    if (!running || (any && finished != -1) || wait_interrupted){
+      break;
+    }
+    // The messages about the jobs that finished go out as they do.
+    if (fflush(stdout) != 0){
+      err_and_ex("fflush error!\n");
+    }
+    struct epoll_event events[64];
+    int n = epoll_wait(epoll_fd, events, 64, -1);
+    if (n == -1){
+      if (errno == EINTR){
+        continue;
+      }
+      err_and_ex("epoll_wait error!\n");
+    }
+    // The jobs of the pidfds are looked up before handle_events removes the ones that
+    // finish, so that with -n the job that finished first is the one whose last process
+    // was ready first, whatever the order of the job specs.
+    int event_jids[n];
+    for (int k = 0; k < n; k++){
+      pid_t pid = (pid_t) (uint32_t) events[k].data.u64;
+      event_jids[k] = events[k].data.u64 >> 32 == EVENT_PIDFD ? get_job_jid(job_list, pid) : -1;
+    }
+    handle_events(events, n);
+    for (int k = 0; k < n && finished == -1; k++){
+      if (event_jids[k] == -1 || get_job_state(job_list, event_jids[k]) != NULL){
+        continue;
+      }
+      for (int i = 0; i < njids; i++){
+        if (jids[i] == event_jids[k]){
+          finished = jids[i];
+        }
+      }
+    }
+  }
+  if (job_control && sigprocmask(SIG_UNBLOCK, &sigint, NULL) == -1){
+    err_and_ex("sigprocmask failed\n");
+  }
+  event.events = EPOLLIN;
+  if (stdin_watched && epoll_ctl(epoll_fd, EPOLL_CTL_MOD, STDIN_FILENO, &event) == -1){
+    err_and_ex("epoll_ctl failed\n");
+  }
+  if (wait_interrupted){
+    return 128 + SIGINT;
+  } else if (any){
+    return finished == -1 ? 127 : get_job_status(job_list, finished);
+  } else if (specs[0] == NULL){
+    return 0;
+  }
+  int last = jids[njids - 1];
+  if (last == -1){
+    return done[njids - 1] != -1 ? done[njids - 1] : 127;
+  }
+  // A job that is still in the list is stopped.
+  return get_job_state(job_list, last) != NULL ? 128 + SIGTSTP : get_job_status(job_list, last);
+}
+/*
+ * This function prints the prompt on stdout if the macro PROMPT is defined, unless
+ * commands come from a script, and flushes the output buffer, so whatever the shell printed
+ * since the last prompt, job messages and the output of jobs included, goes out in one
+ * write.
+ *
+ * arguments: no arguments
+ *
+ * returns nothing.
+ */
+void print_prompt(){
+  #ifdef PROMPT
+  // Nobody is typing commands in when they come from a script, so there is no prompt then.
+  if (!script_mode){
+    if (printf("33sh> ") < 0){
+      err_and_ex("printf error!\n");
+    }
+  }
+  #endif
+  if (fflush(stdout) != 0){
+    err_and_ex("fflush error!\n");
+  }
+}
+/*
+ * This function is what the reader calls before it reads from stdin. It sleeps in
+ * epoll_wait on stdin, on the signalfd that SIGCHLD is delivered to and on the pidfds of
+ * running processes, and whenever a child changes state it reaps it right away, instead of
+ * the change only being noticed the next time the user presses enter. If there was
+ * anything to report, the prompt is printed again after the messages. Returns once stdin
+ * is readable.
+ *
+ * arguments: fd, the file descriptor the reader is about to read from.
+ *
+ * returns nothing.
+ */
+void wait_for_input(int fd){
+  // The shell is idle until the user types something, so the lines of the history that are
+  // waiting are written now, in case it does not get to exit normally. A failed write is
+  // tried again later.
+  flush_history(history);
+  struct epoll_event events[64];
+  for (;;){
+    int n = epoll_wait(epoll_fd, events, 64, -1);
+    if (n == -1){
+      if (errno == EINTR){
+        continue;
+      }
+      err_and_ex("epoll_wait error!\n");
+    }
+    if (handle_events(events, n)){
+      print_prompt();
+    }
+    for (int k = 0; k < n; k++){
+      // Hang ups and errors count as readable too, so that read reports them.
+      if (events[k].data.u64 == EVENT_DATA(EVENT_STDIN, fd)){
+        return;
+      }
+    }
+  }
+}
+/*
+ * This function applies the redirections of a built-in command to the shell itself, since
+ * the command runs without a process of its own. The stdin and stdout of the shell are
+ * saved first, for restore_builtin to put back.
+ *
+ * arguments: redir_arg, the redirections, as parse lays them out. saved, where the saved
+ * stdin and stdout are stored, -1 for those that are not redirected. in_fd, the file
+ * holding the here-document or here-string of the command, or -1.
+ *
+ * return value of 0 indicates success, -1 indicates a file that could not be opened.
+ */
+int redirect_builtin(char** redir_arg, int* saved, int in_fd){
+  saved[STDIN_FILENO] = -1;
+  saved[STDOUT_FILENO] = -1;
+  if (in_fd != -1){
+    if ((saved[STDIN_FILENO] = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10)) == -1){
+      err_and_ex("fcntl failed\n");
+    }
+    if (dup2(in_fd, STDIN_FILENO) == -1){
+      err_and_ex("dup2 error!\n");
+    }
+  }
+  for (int i = 0; redir_arg[i] != 0; i += 2){
+    if (redir_arg[i][0] == '<' && redir_arg[i][1] == '<'){
+      continue;
+    }
+    int fd = redir_arg[i][0] == '>' ? STDOUT_FILENO : STDIN_FILENO;
+    int flags = fd == STDIN_FILENO ? O_RDONLY : O_CREAT | O_WRONLY | (redir_arg[i][1] ? O_APPEND : O_TRUNC);
+    if (saved[fd] == -1){
+      // What was printed so far belongs to the old stdout.
+      fflush(stdout);
+      if ((saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 10)) == -1){
+        err_and_ex("fcntl failed\n");
+      }
+    }
+    // The redirections are applied in order, so a file the cache has open can stand in for
+    // any >> or <, and stays open afterwards.
+    int cached = -1;
+    if (fd_cache != NULL && (fd == STDIN_FILENO || redir_arg[i][1])){
+      cached = get_redir_fd(fd_cache, redir_arg[i + 1], fd == STDOUT_FILENO);
+    }
+    int file = cached != -1 ? cached : open(redir_arg[i + 1], flags | O_CLOEXEC, 0666);
+    if (file == -1){
+      fprintf(stderr, "%s: %s\n", redir_arg[i + 1], strerror(errno));
+      return -1;
+    }
+    if (dup2(file, fd) == -1){
+      err_and_ex("dup2 error!\n");
+    }
+    if (cached == -1){
+      close(file);
+    }
+  }
+  return 0;
+}
+/*
+ * This function puts back the stdin and stdout of the shell saved by redirect_builtin. What
+ * the command printed to a redirected stdout is flushed to it first; otherwise it stays in
+ * the output buffer until the next prompt or job.
+ *
+ * arguments: saved, as filled in by redirect_builtin.
+ *
+ * returns 0 on success, -1 if what was printed could not be written to the file.
+ */
+int restore_builtin(int* saved){
+  int ret = 0;
+  if (saved[STDOUT_FILENO] != -1 && (fflush(stdout) != 0 || ferror(stdout))){
+    clearerr(stdout);
+    ret = -1;
+  }
+  for (int fd = STDIN_FILENO; fd <= STDOUT_FILENO; fd++){
+    if (saved[fd] != -1){
+      if (dup2(saved[fd], fd) == -1){
+        err_and_ex("dup2 error!\n");
+      }
+      close(saved[fd]);
+      saved[fd] = -1;
+    }
+  }
+  return ret;
+}
+/*
+ * This function makes sure the buffer a here-document is put together in can hold len bytes.
+ *
+ * arguments: len, the number of bytes.
+ *
+ * returns nothing.
+ */
+void grow_heredoc(size_t len){
+  if (len <= heredoc_cap){
+    return;
+  }
+  size_t cap = heredoc_cap ? heredoc_cap : 4096;
+  while (cap < len){
+    cap *= 2;
+  }
+  char* grown = realloc(heredoc, cap);
+  if (grown == NULL){
+    err_and_ex("malloc failed\n");
+  }
+  heredoc = grown;
+  heredoc_cap = cap;
+}
+/*
+ * This function reads the body of a here-document: the lines that come after the command,
+ * from the same input, up to the line that is just the delimiter. When commands are typed
+ * in, each line is prompted for with "> ". If the input ends before the delimiter, what was
+ * read so far is the body, as in other shells.
+ *
+ * arguments: delimiter, the word after <<.
+ *
+ * returns the length of the body, which is put in heredoc, or -1 if the input could not
+ * be read.
+ */
+long read_heredoc(const char* delimiter){
+  size_t len = 0;
+  for (;;){
+    #ifdef PROMPT
+    if (!script_mode){
+      if (printf("> ") < 0){
+        err_and_ex("printf error!\n");
+      }
+    }
+    #endif
+    if (fflush(stdout) != 0){
+      err_and_ex("fflush error!\n");
+    }
+    char* line;
+    size_t line_len;
+    int got_line = read_line(reader, &line, &line_len);
+    if (got_line < 0){
+      return -1;
+    } else if (got_line == 0){
+      fprintf(stderr, "warning: here-document delimited by end-of-file (wanted `%s')\n", delimiter);
+      // ^D on a terminal only ends the here-document, not the shell.
+      if (!script_mode){
+        clear_line_reader_eof(reader);
+      }
+      break;
+    }
+    if (!strcmp(line, delimiter)){
+      break;
+    }
+    grow_heredoc(len + line_len + 1);
+    memcpy(heredoc + len, line, line_len);
+    heredoc[len + line_len] = '\n';
+    len += line_len + 1;
+  }
+  return (long) len;
+}
+/*
+ * This function puts the body of a here-document or here-string in a file that only lives
+ * in memory, made with memfd_create, so that nothing is written to the filesystem and there
+ * is nothing to clean up. Once the body is in, the file is sealed so that nobody can change
+ * it, the command reading it included, and it is read from the start.
+ *
+ * arguments: body, the body. len, its length.
+ *
+ * returns the file descriptor, which is close-on-exec, or -1 on failure, in which case the
+ * reason is printed.
+ */
+int make_here_fd(const char* body, size_t len){
+  int fd = memfd_create("33sh-here", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1){
+    fprintf(stderr, "here-document: %s\n", strerror(errno));
+    return -1;
+  }
+  size_t written = 0;
+  while (written < len){
+    ssize_t n = write(fd, body + written, len - written);
+    if (n == -1 && errno == EINTR){
+      continue;
+    } else if (n == -1){
+      fprintf(stderr, "here-document: %s\n", strerror(errno));
+      close(fd);
+      return -1;
+    }
+    written += (size_t) n;
+  }
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) == -1
+      || lseek(fd, 0, SEEK_SET) == -1){
+    fprintf(stderr, "here-document: %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+/*
+ * This function closes the files made by open_here_inputs.
+ *
+ * arguments: input_fds and nstages, as for open_here_inputs.
+ *
+ * returns nothing.
+ */
+void close_here_inputs(int* input_fds, int nstages){
+  for (int i = 0; i < nstages; i++){
+    if (input_fds[i] != -1){
+      close(input_fds[i]);
+      input_fds[i] = -1;
+    }
+  }
+}
+/*
+ * This function makes the files the here-documents and here-strings of a plan are read
+ * from, a stage at a time. A here-string is its word followed by a newline; the body of a
+ * here-document is read from the input of the shell, which is why it has to be done every
+ * time the plan is executed.
+ *
+ * arguments: plan, the plan. input_fds, an array with an entry for each stage of the plan,
+ * which gets the file of the stage, or -1 if it has none. may_read, whether here-documents
+ * may be read; they may not when the lines do not come from the input of the shell.
+ *
+ * return value of 0 indicates success, -1 indicates failure, in which case nothing is
+ * left open and the reason is printed.
+ */
+int open_here_inputs(plan_t* plan, int* input_fds, int may_read){
+  for (int i = 0; i < plan->nstages; i++){
+    input_fds[i] = -1;
+  }
+  for (int i = 0; i < plan->nstages; i++){
+    char** redir_arg = plan->redir_args[i];
+    for (int k = 0; redir_arg[k] != 0; k += 2){
+      if (redir_arg[k][0] != '<' || redir_arg[k][1] != '<'){
+        continue;
+      }
+      long len;
+      if (redir_arg[k][2]){
+        len = (long) strlen(redir_arg[k + 1]);
+        grow_heredoc((size_t) len + 1);
+        memcpy(heredoc, redir_arg[k + 1], (size_t) len);
+        heredoc[len++] = '\n';
+      } else if (!may_read){
+        fprintf(stderr, "here-document: only allowed in lines read by the shell\n");
+        close_here_inputs(input_fds, plan->nstages);
+        return -1;
+      } else if ((len = read_heredoc(redir_arg[k + 1])) == -1){
+        err_and_ex("read error!\n");
+      }
+      input_fds[i] = make_here_fd(heredoc, (size_t) len);
+      if (input_fds[i] == -1){
+        close_here_inputs(input_fds, plan->nstages);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+/*
+ * This function reads the here-documents of a plan that is not executed and throws them
+ * away, so that their bodies are not taken for commands.
+ *
+ * arguments: plan, the plan.
+ *
+ * returns nothing.
+ */
+void skip_here_documents(plan_t* plan){
+  for (int i = 0; i < plan->nstages; i++){
+    for (char** redir_arg = plan->redir_args[i]; *redir_arg != 0; redir_arg += 2){
+      if (!strcmp(*redir_arg, "<<") && read_heredoc(redir_arg[1]) == -1){
+        err_and_ex("read error!\n");
+      }
+    }
+  }
+}
+/*
+ * This function executes the plan of a line, either as a built-in command or with
+ * run_cmd. If started is not null, the line is instead started as a background job with
+ * start_job, quietly, and nothing is waited for; built-in commands are not looked at then.
+ *
+ * arguments: plan, what the line was parsed into. started, null, or where the pid of the
+ * job started is stored (0 if none was).
+ *
+ * return value of 0 indicates success, 1 indicates a job that could not be started.
+ */
+int run_plan(plan_t* plan, pid_t* started){
+  int input_fds[plan->nstages];
+  if (open_here_inputs(plan, input_fds, started == NULL) == -1){
+    last_status = 1;
+    return 1;
+  }
+  // The locations a plan from the cache keeps are dropped once PATH or its directories
+  // change.
+  if (plan->paths != NULL){
+    check_plan_paths(plan, path_cache_epoch(path_cache));
+  }
+  if (started != NULL){
+    // The job is started in the background whether or not the line ends with &.
+    *started = start_job(plan->cmd_args, plan->redir_args, 0, &plan->run, input_fds, plan->paths);
+    close_here_inputs(input_fds, plan->nstages);
+    return *started ? 0 : 1;
+  }
+  // A line starting with time runs the rest of the line and then prints how long it took
+  // on stderr, along with the CPU time its job used, which is known once it is reaped.
+  // A built-in command has no job, and is timed by the CPU time the shell itself uses.
+  struct timespec started_at;
+  struct rusage self_before;
+  if (plan->timed){
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    if (getrusage(RUSAGE_SELF, &self_before) == -1){
+      err_and_ex("getrusage failed\n");
+    }
+  }
+  // The job will get the lowest job id that is free now.
+  int timed_jid = get_free_jid(job_list);
+  int ran_job = 0;
+  // If the user enters a built-in command, it is executed, and 0 is returned because we do not want
+  // run_cmd to be executed if a built-in command is executed. Built-in commands cannot be
+  // stages of a pipeline. Their redirections are applied to the shell while they run.
+  long long builtin_start = trace_now(trace);
+  int builtin = 0;
+  if (plan->builtin != -1){
+    int saved[2];
+    if (redirect_builtin(plan->redir_args[0], saved, input_fds[0]) == -1){
+      last_status = 1;
+      builtin = 1;
+    } else {
+      last_status = 0;
+      builtin = !run_built_in_cmd(plan->builtin, plan->cmd_args[0]);
+    }
+    if (restore_builtin(saved) == -1){
+      fprintf(stderr, "write error\n");
+      last_status = 1;
+    }
+  }
+  trace_span(trace, "builtin", 0, builtin_start, trace_now(trace), NULL);
+  if (!builtin){
+    ran_job = !run_cmd(plan->cmd_args, plan->redir_args, plan->background, &plan->run, input_fds,
+      plan->paths);
+  }
+  // The children have their own copies of the files by now.
+  close_here_inputs(input_fds, plan->nstages);
+  if (plan->timed){
+    struct timespec ended_at;
+    clock_gettime(CLOCK_MONOTONIC, &ended_at);
+    double real = (double) (ended_at.tv_sec - started_at.tv_sec) + (double) (ended_at.tv_nsec - started_at.tv_nsec) / 1e9;
+    struct rusage usage;
+    if (!ran_job){
+      if (getrusage(RUSAGE_SELF, &usage) == -1){
+        err_and_ex("getrusage failed\n");
+      }
+      timersub(&usage.ru_utime, &self_before.ru_utime, &usage.ru_utime);
+      timersub(&usage.ru_stime, &self_before.ru_stime, &usage.ru_stime);
+    } else if (get_job_usage(job_list, timed_jid, &usage) == -1){
+      memset(&usage, 0, sizeof(usage));
+    }
+    fprintf(stderr, "real\t%.3fs\nuser\t%ld.%03lds\nsys\t%ld.%03lds\n", real,
+      (long) usage.ru_utime.tv_sec, (long) usage.ru_utime.tv_usec / 1000,
+      (long) usage.ru_stime.tv_sec, (long) usage.ru_stime.tv_usec / 1000);
+  }
+  if (job_control && tcsetpgrp(STDIN_FILENO, jpid_shell) == -1){
+    err_and_ex("tcsetgprg failed\n");
+  }
+  return 0;
+}
+/*
+ * This function executes the plans of a line with run_plan, one after the other: a plan
+ * after && only if the one before it succeeded, and one after || only if it failed, going
+ * by the exit status of the last plan executed, as in a && b || c. A foreground job
+ * interrupted with ^C stops the rest of the line. The here-documents of the plans that are
+ * not executed are still read, since their bodies are not commands.
+ *
+ * arguments: plans, the plans of the line. started, as for run_plan, in which case the line
+ * must have a single plan.
+ *
+ * returns what run_plan returned for the last plan executed, 0 if none was.
+ */
+int run_plans(plan_t* plans, pid_t* started){
+  if (started != NULL && plans[0].nplans > 1){
+    fprintf(stderr, "parallel: a line can only start one job\n");
+    return 1;
+  }
+  int ret = 0;
+  int interrupted = 0;
+  for (int k = 0; k < plans[0].nplans; k++){
+    plan_t* plan = &plans[k];
+    if (interrupted || (plan->op == _PLAN_AND && last_status != 0)
+        || (plan->op == _PLAN_OR && last_status == 0)){
+      skip_here_documents(plan);
+      continue;
+    }
+    ret = run_plan(plan, started);
+    interrupted = !plan->background && last_status == 128 + SIGINT;
+  }
+  return ret;
+}
+/*
+ * This function finds the plans of a line in the plan cache, or else parses the line into
+ * plans and remembers them, and executes them with run_plans. A line that was seen before,
+ * exactly as it is, skips parsing and goes straight to being executed. What the line is
+ * parsed into is taken from the arena, which is reset first.
+ *
+ * arguments: arena, the arena of the caller. p, the line, which is left as it is.
+ * input_len, its length. started, as for run_plan.
+ *
+ * return value of 0 indicates success, 1 indicates a line that was not valid or a job that
+ * could not be started. An empty line is a success.
+ */
+int eval_line(parse_arena_t* arena, char* p, size_t input_len, pid_t* started){
+  if (started != NULL){
+    *started = 0;
+  }
+  long long lookup_start = trace_now(trace);
+  uint64_t hash = hash_line(p, input_len);
+  plan_t* plan = find_plan(plan_cache, p, input_len, hash);
+  trace_span(trace, "plan lookup", 0, lookup_start, trace_now(trace), plan != NULL ? plan->cmd_args[0][0] : NULL);
+  if (plan == NULL){
+    // The arrays parse fills in come from the arena, which only allocates when a line is
+    // longer than any before it. The line is lexed where the reader has it, and only its
+    // words are copied, so they do not point into the buffer of the reader, which reading
+    // a here-document reuses.
+    reset_parse_arena(arena);
+    size_t max = input_len + 2;
+    char** cmd_arg = arena_alloc(arena, max * sizeof(char*));
+    char** redir_arg = arena_alloc(arena, max * sizeof(char*));
+    char*** stage_cmd_args = arena_alloc(arena, max * sizeof(char**));
+    char*** stage_redir_args = arena_alloc(arena, max * sizeof(char**));
+    plan_t* parsed = arena_alloc(arena, (input_len / 2 + 1) * sizeof(plan_t));
+    char* words = arena_alloc(arena, input_len + 1);
+    if (cmd_arg == NULL || redir_arg == NULL || stage_cmd_args == NULL || stage_redir_args == NULL
+        || parsed == NULL || words == NULL){
+      err_and_ex("malloc failed\n");
+    }
+    lexer_t lexer;
+    init_lexer(&lexer, p, input_len);
+    long long parse_start = trace_now(trace);
+    int nplans = parse(&lexer, cmd_arg, redir_arg, stage_cmd_args, stage_redir_args, words, parsed);
+    trace_span(trace, "parse", 0, parse_start, trace_now(trace), nplans > 0 ? cmd_arg[0] : NULL);
+    // If parsing is successful, meaning the command entered by the user is valid, we want to
+    // execute the commands specified by the user. If not, we want to start from the beginning.
+    if (nplans <= 0){
+      return nplans < 0;
+    }
+    for (int k = 0; k < nplans; k++){
+      plan_t* next = &parsed[k];
+      // time is taken off the words of the first stage, and remembered in the plan instead.
+      next->timed = !strcmp(next->cmd_args[0][0], "time");
+      if (next->timed){
+        if (next->cmd_args[0][1] == 0){
+          fprintf(stderr, "time: no command\n");
+          return 1;
+        }
+        next->cmd_args[0]++;
+      }
+      // So are run and its options, which the job is launched with.
+      memset(&next->run, 0, sizeof(next->run));
+      if (!strcmp(next->cmd_args[0][0], "run")){
+        int nwords = parse_run_opts(next->cmd_args[0], &next->run);
+        if (nwords == -1){
+          return 1;
+        } else if (next->cmd_args[0][nwords] == 0){
+          fprintf(stderr, "run: no command\n");
+          return 1;
+        }
+        next->cmd_args[0] += nwords;
+      }
+      next->builtin = next->nstages == 1 ? builtin_id(next->cmd_args[0][0]) : -1;
+      // Built-in commands run in the shell, which the settings of run are not meant for.
+      if (next->run.flags){
+        next->builtin = -1;
+      }
+      // A utility asked to run in the background is left to its program, so the shell does
+      // not wait for it.
+      if (next->background && next->builtin >= BUILTIN_ECHO){
+        next->builtin = -1;
+      }
+    }
+    // A line that is too long to be remembered is run from the arena.
+    plan = add_plan(plan_cache, p, input_len, hash, parsed, words);
+    if (plan == NULL){
+      return run_plans(parsed, started);
+    }
+  }
+  int ret = run_plans(plan, started);
+  release_plan(plan_cache, plan);
+  return ret;
+}
+/*
+ * This function reaps a process of a job started by run_parallel, quietly, and records
+ * how the job went in its slot. The job is removed from the jobs list once all its
+ * processes are reaped.
+ *
+ * arguments: info, what waitid reported about the process. slot_jid, slot_line and
+ * slot_status, the slots of run_parallel.
+ *
+ * returns the index of the slot whose job is done, -1 if the job is still running.
+ */
+int reap_parallel(siginfo_t* info, int* slot_jid, char** slot_line, int* slot_status){
+  int job_jid = get_job_jid(job_list, info->si_pid);
+  int k = 0;
+  while (slot_jid[k] != job_jid){
+    k++;
+  }
+  unwatch_pidfd(info->si_pid);
+  // The job failed if any of its processes did. Like wait_job, a process killed by SIGPIPE
+  // does not count, since that is how the stages before a head normally end.
+  if (!slot_status[k] && (info->si_code == CLD_EXITED ? info->si_status != 0 : info->si_status != SIGPIPE)){
+    slot_status[k] = info->si_code == CLD_EXITED ? info->si_status : 128 + info->si_status;
+    if (info->si_code == CLD_EXITED){
+      fprintf(stderr, "parallel: %s: exit status %d\n", slot_line[k], info->si_status);
+    } else {
+      fprintf(stderr, "parallel: %s: terminated by signal %d\n", slot_line[k], info->si_status);
+    }
+  }
+  if (finish_job_process(job_list, info->si_pid) > 0){
+    return -1;
+  }
+  remove_job(job_jid);
+  return k;
+}
+/*
+ * This function is the parallel builtin. Reads commands, one per line, from a file or
+ * from stdin up to its end, and runs them as background jobs, keeping up to N of them
+ * running at once. Every line is a command or a pipeline, as typed at the prompt, but
+ * built-in commands are not recognized. A line that fails is reported on stderr as its
+ * job ends, and once every job has ended the number of lines run, how long they took and
+ * how many failed is printed. Jobs that are not from parallel keep being reported as usual.
+ * A job that is stopped counts as failed and is left in the jobs list, where fg or bg can
+ * resume it, rather than waited for, since nothing else would resume it.
+ *
+ * arguments: argv, parallel [-j N] [file]. N defaults to the number of online CPUs.
+ *
+ * returns the number of lines that failed, -1 if the arguments are not valid.
+ */
+int run_parallel(char** argv){
+  long njobs = sysconf(_SC_NPROCESSORS_ONLN);
+  char* file = NULL;
+  int k = 1;
+  if (argv[k] && !strcmp(argv[k], "-j")){
+    char* end = "";
+    if (argv[k + 1]){
+      njobs = strtol(argv[k + 1], &end, 10);
+    }
+    if (!argv[k + 1] || *end || njobs < 1 || njobs > 4096){
+      fprintf(stderr, "parallel: -j needs a number of jobs between 1 and 4096\n");
+      return -1;
+    }
+    k += 2;
+  }
+  if (argv[k]){
+    file = argv[k++];
+  }
+  if (argv[k]){
+    fprintf(stderr, "usage: parallel [-j N] [file]\n");
+    return -1;
+  }
+  if (njobs < 1){
+    njobs = 1;
+  }
+  // Lines come from the file, or from the reader of the main loop when it reads stdin, so
+  // that lines it already buffered are not lost. It must not wait on stdin the usual way,
+  // since that would reap the jobs started here behind this function's back. A script
+  // reads from its own file, so stdin gets a reader of its own then.
+  line_reader_t* input = reader;
+  if (file != NULL){
+    input = init_line_reader_mmap(file);
+    if (input == NULL){
+      fprintf(stderr, "parallel: %s: cannot open\n", file);
+      return -1;
+    }
+  } else if (script_mode){
+    input = init_line_reader(STDIN_FILENO);
+    if (input == NULL){
+      err_and_ex("malloc failed\n");
+    }
+  } else {
+    set_line_reader_wait(reader, NULL);
+  }
+  // Stdin stays readable while it is not read, so it is taken out of the epoll set.
+  struct epoll_event event;
+  event.events = 0;
+  event.data.u64 = EVENT_DATA(EVENT_STDIN, STDIN_FILENO);
+  if (stdin_watched && epoll_ctl(epoll_fd, EPOLL_CTL_MOD, STDIN_FILENO, &event) == -1){
+    err_and_ex("epoll_ctl failed\n");
+  }
+  // Every slot holds the job id of a job that is running, 0 when it is free, the line the
+  // job runs, for error messages, and the status the job failed with, 0 so far.
+  int nslots = (int) njobs;
+  int* slot_jid = calloc((size_t) nslots, sizeof(int));
+  char** slot_line = calloc((size_t) nslots, sizeof(char*));
+  int* slot_status = calloc((size_t) nslots, sizeof(int));
+  // The lines are parsed into an arena of their own, as the one of the main loop is still
+  // holding the parallel command itself.
+  parse_arena_t* parallel_arena = init_parse_arena();
+  if (slot_jid == NULL || slot_line == NULL || slot_status == NULL || parallel_arena == NULL){
+    err_and_ex("malloc failed\n");
+  }
+  unsigned long ran = 0;
+  unsigned long failed = 0;
+  int running = 0;
+  int more = 1;
+  struct timespec started_at;
+  clock_gettime(CLOCK_MONOTONIC, &started_at);
+  while (more || running){
+    // Filling every free slot before waiting for a job to end.
+    while (more && running < nslots){
+      char* p;
+      size_t input_len;
+      int got_line = read_line(input, &p, &input_len);
+      if (got_line < 0){
+        err_and_ex("read error!\n");
+      } else if (got_line == 0){
+        more = 0;
+        break;
+      }
+      // The line is kept for error messages before it is split up into words.
+      char* line = strdup(p);
+      if (line == NULL){
+        err_and_ex("malloc failed\n");
+      }
+      pid_t jpid;
+      if (eval_line(parallel_arena, p, input_len, &jpid)){
+        // Not valid or not started, the reason is already printed.
+        ran++;
+        failed++;
+        free(line);
+        continue;
+      } else if (!jpid){
+        // An empty line.
+        free(line);
+        continue;
+      }
+      k = 0;
+      while (slot_jid[k]){
+        k++;
+      }
+      slot_jid[k] = get_job_jid(job_list, jpid);
+      slot_line[k] = line;
+      slot_status[k] = 0;
+      running++;
+      ran++;
+    }
+    if (!running){
+      continue;
+    }
+    struct epoll_event events[64];
+    int n = epoll_wait(epoll_fd, events, 64, -1);
+    if (n == -1){
+      if (errno == EINTR){
+        continue;
+      }
+      err_and_ex("epoll_wait error!\n");
+    }
+    for (int e = 0; e < n; e++){
+      pid_t pid = (pid_t) (uint32_t) events[e].data.u64;
+      int job_jid = events[e].data.u64 >> 32 == EVENT_PIDFD ? get_job_jid(job_list, pid) : -1;
+      int mine = 0;
+      for (k = 0; k < nslots && job_jid != -1 && !mine; k++){
+        mine = slot_jid[k] == job_jid;
+      }
+      if (!mine){
+        if (handle_events(&events[e], 1) && fflush(stdout) != 0){
+          err_and_ex("fflush error!\n");
+        }
+        continue;
+      }
+      // As in handle_events, the process may have been reaped since epoll_wait returned.
+      int pidfd = get_job_pidfd(job_list, pid);
+      if (pidfd == -1){
+        continue;
+      }
+      siginfo_t info;
+      info.si_pid = 0;
+      if (wait_child(P_PIDFD, (id_t) pidfd, &info, WEXITED | WNOHANG) == -1){
+        if (errno == ECHILD || errno == EBADF){
+          continue;
+        }
+        err_and_ex("waitid error!\n");
+      }
+      if (!info.si_pid){
+        continue;
+      }
+      k = reap_parallel(&info, slot_jid, slot_line, slot_status);
+      if (k != -1){
+        failed += slot_status[k] != 0;
+        free(slot_line[k]);
+        slot_line[k] = NULL;
+        slot_jid[k] = 0;
+        running--;
+      }
+    }
+    // Stops arrive through SIGCHLD, which handle_events has marked in the jobs list. The
+    // slot of a stopped job is given up.
+    for (k = 0; k < nslots; k++){
+      process_state_t state = slot_jid[k] ? get_job_state(job_list, slot_jid[k]) : NULL;
+      if (state == NULL || strcmp(state, _STATE_STOPPED)){
+        continue;
+      }
+      fprintf(stderr, "parallel: %s: stopped, left as job %d\n", slot_line[k], slot_jid[k]);
+      failed++;
+      free(slot_line[k]);
+      slot_line[k] = NULL;
+      slot_jid[k] = 0;
+      running--;
+    }
+  }
+  struct timespec ended_at;
+  clock_gettime(CLOCK_MONOTONIC, &ended_at);
+  double seconds = (double) (ended_at.tv_sec - started_at.tv_sec) + (double) (ended_at.tv_nsec - started_at.tv_nsec) / 1e9;
+  if (printf("parallel: %lu commands in %.3f s (%.1f/s), %lu failed\n", ran, seconds, seconds > 0 ? (double) ran / seconds : 0.0, failed) < 0){
+    err_and_ex("printf error!\n");
+  }
+  free(slot_jid);
+  free(slot_line);
+  free(slot_status);
+  cleanup_parse_arena(parallel_arena);
+  if (input != reader){
+    cleanup_line_reader(input);
+  } else {
+    // The user typed ^D to end the input of parallel, not of the shell.
+    if (isatty(STDIN_FILENO)){
+      clear_line_reader_eof(reader);
+    }
+    if (stdin_watched){
+      set_line_reader_wait(reader, wait_for_input);
+    }
+  }
+  event.events = EPOLLIN;
+  if (stdin_watched && epoll_ctl(epoll_fd, EPOLL_CTL_MOD, STDIN_FILENO, &event) == -1){
+    err_and_ex("epoll_ctl failed\n");
+  }
+  return (int) failed;
+}
+/*
+ * This function recalls a line from the history when the line starts with !n, for line n
+ * of the history, or !prefix, for the newest line starting with prefix. What comes after
+ * that in the line is kept. The line recalled is printed, as though it had been typed.
+ *
+ * arguments: p, the line. len, its length, which is changed to the length of the line
+ * returned.
+ *
+ * returns the line to execute, which is p if it does not start with !, or null if there
+ * is no such line in the history.
+ */
+char* recall_history(char* p, size_t* len){
+  size_t start = 0;
+  while (start < *len && (p[start] == ' ' || p[start] == '\t')){
+    start++;
+  }
+  if (start == *len || p[start] != '!'){
+    return p;
+  }
+  size_t end = start + 1;
+  int number = 1;
+  while (end < *len && p[end] != ' ' && p[end] != '\t'){
+    number = number && p[end] >= '0' && p[end] <= '9';
+    end++;
+  }
+  // ! on its own is left alone.
+  if (end == start + 1){
+    return p;
+  }
+  long found;
+  if (number){
+    unsigned long n = strtoul(p + start + 1, NULL, 10);
+    found = n >= 1 && n <= count_history(history) ? (long) n - 1 : -1;
+  } else {
+    found = find_history(history, p + start + 1, end - start - 1, 1, count_history(history));
+  }
+  if (found == -1){
+    fprintf(stderr, "%.*s: event not found\n", (int) (end - start), p + start);
+    return NULL;
+  }
+  size_t line_len;
+  const char* line = get_history(history, (size_t) found, &line_len);
+  size_t new_len = line_len + *len - end;
+  if (new_len + 1 > recalled_cap){
+    char* grown = realloc(recalled, new_len + 1);
+    if (grown == NULL){
+      err_and_ex("malloc failed\n");
+    }
+    recalled = grown;
+    recalled_cap = new_len + 1;
+  }
+  memcpy(recalled, line, line_len);
+  memcpy(recalled + line_len, p + end, *len - end);
+  recalled[new_len] = '\0';
+  if (printf("%s\n", recalled) < 0){
+    err_and_ex("printf error!\n");
+  }
+  *len = new_len;
+  return recalled;
+}
+/*
+ * My implementation of REPL. Prints a prompt on stdout if the macro PROMPT
+ * is defined. Reads command from stdin, parses the command, either performs built-in
+ * commands or commands that are not built in.
+ * 
+ * arguments: no arguments
+ *
+ * returns 1 upon success.
+ */
+int repl(){
+  // Reaping whatever changed while the last command ran.
+  reap_jobs();
+  print_prompt();
+  // The reader hands out one line at a time, so lines that arrived together in one read
+  // (as they do when stdin is a file or a pipe) are each executed in turn, and lines longer
+  // than a single read are put back together. The newline is already replaced with the
+  // null character.
+  char* p;
+  size_t input_len;
+  long long read_start = trace_now(trace);
+  int got_line = read_line(reader, &p, &input_len);
+  trace_span(trace, "read", 0, read_start, trace_now(trace), NULL);
+  // If there is an error reading, -1 is returned to got_line, in which case
+  // the program must exit() with 1 passed to exit to indicate error.
+  if (got_line < 0){
+    // Error handling read()
+    err_and_ex("read error!\n");
+  } else if (got_line == 0){
+    cleanup_line_reader(reader);
+    cleanup_path_cache(path_cache);
+    cleanup_parse_arena(arena);
+    cleanup_plan_cache(plan_cache);
+    cleanup_fd_cache(fd_cache);
+    cleanup_history(history);
+    cleanup_job_list(job_list);
+    cleanup_trace(trace);
+    exit(0);
+  } else if (input_len == 0){
+    // If user presses enter, must return (returns 0 since this is not an error)
+    // because we want our prompt to still be displayed and our program to continue
+    // running.
+    return 0;
+  } else {
+    // The line goes in the history before it is executed, since parsing it null terminates
+    // its words. Lines are written to the history file once a few kilobytes of them have
+    // piled up, before the shell waits for the user to type the next one, and when it
+    // exits. A script has no history to recall from.
+    if (!script_mode){
+      p = recall_history(p, &input_len);
+      if (p == NULL){
+        return 0;
+      }
+      if (add_history(history, p, input_len) == -1){
+        err_and_ex("malloc failed\n");
+      }
+    }
+    eval_line(arena, p, input_len, NULL);
+  }
+  return 0;
+}
+/*
+ * My main method
+ * 
+ * arguments: optionally -f followed by a script, in which case commands are
+ * read from the script instead of stdin. The script is mapped into memory and
+ * executed line by line straight out of the mapping.
+ * Optionally -t followed by a file, in which case the time every command spends in
+ * each phase, from reading it to handing the terminal back, is written to the file as a
+ * trace that Chrome's about:tracing and Perfetto can show on a timeline.
+ *
+ * returns 0.
+ */
+int main(int argc, char** argv){
+  // stdout is the output buffer of the shell. It is only flushed before the prompt, before
+  // a job is started and before the shell waits, instead of after every line, so that
+  // reaping or listing many jobs costs a few writes instead of one per job.
+  static char output_buf[_OUTPUT_BUF_LEN];
+  if (setvbuf(stdout, output_buf, _IOFBF, sizeof(output_buf)) != 0){
+    err_and_ex("setvbuf failed\n");
+  }
+  //Initializing jobs list.
+  job_list = init_job_list();
+  //Initializing the cache of where commands found in PATH live.
+  path_cache = init_path_cache();
+  if (path_cache == NULL){
+    err_and_ex("malloc failed\n");
+  }
+  //Initializing the arena lines are parsed into.
+  arena = init_parse_arena();
+  if (arena == NULL){
+    err_and_ex("malloc failed\n");
+  }
+  //Initializing the cache of the plans of lines already run.
+  plan_cache = init_plan_cache();
+  if (plan_cache == NULL){
+    err_and_ex("malloc failed\n");
+  }
+  char* script = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:t:")) != -1){
+    if (opt == 'f'){
+      script = optarg;
+    } else if (opt == 't'){
+      trace = init_trace(optarg);
+      if (trace == NULL){
+        fprintf(stderr, "%s: ", optarg);
+        err_and_ex("cannot open trace\n");
+      }
+    } else {
+      err_and_ex("usage: 33sh [-f script] [-t trace]\n");
+    }
+  }
+  if (optind < argc){
+    err_and_ex("usage: 33sh [-f script] [-t trace]\n");
+  }
+  // The history file is only mapped here, it is not read until a line of it is asked for.
+  char history_path[PATH_MAX];
+  const char* history_file = NULL;
+  if (script == NULL){
+    if (getenv("HISTFILE") != NULL){
+      history_file = getenv("HISTFILE");
+    } else if (getenv("HOME") != NULL && snprintf(history_path, sizeof(history_path), "%s/.33sh_history",
+        getenv("HOME")) < (int) sizeof(history_path)){
+      history_file = history_path;
+    }
+  }
+  history = init_history(history_file);
+  if (history == NULL){
+    err_and_ex("malloc failed\n");
+  }
+  //Initializing the reader commands are read from.
+  if (script != NULL){
+    script_mode = 1;
+    reader = init_line_reader_mmap(script);
+    if (reader == NULL){
+      fprintf(stderr, "%s: ", script);
+      err_and_ex("cannot open script\n");
+    }
+  } else {
+    reader = init_line_reader(STDIN_FILENO);
+    if (reader == NULL){
+      err_and_ex("malloc failed\n");
+    }
+  }
   //Initializing the job id of shell. 
+  pid_shell = getpid();
   jpid_shell = getpgid(getpid());
   if (jpid_shell == -1){
     err_and_ex("getpgid failed\n");
   }
+  // Whether there is a terminal to do job control on is only looked at once, here, and
+  // decides what every command started later sets up.
+  job_control = isatty(STDIN_FILENO);
   // Want to ignore the following signals when there is no
   // foreground jobs.
-  if (jpid_shell == -1){
-    err_and_ex("getpgid failed\n");
+  if (job_control){
+    if (signal(SIGINT, SIG_IGN) == SIG_ERR){
+      err_and_ex("signal failed\n");
+    }
+    if (signal(SIGTSTP, SIG_IGN) == SIG_ERR){
+      err_and_ex("signal failed\n");
+    }
+    if (signal(SIGQUIT, SIG_IGN) == SIG_ERR){
+      err_and_ex("signal failed\n");
+    }
+    if (signal(SIGTTOU, SIG_IGN) == SIG_ERR){
+      err_and_ex("signal failed\n");
+    }
+  }
+  // SIGCHLD is blocked and read from a signalfd instead, so that waiting for the next line
+  // and noticing children that change state can be done in one epoll_wait.
+  sigset_t sigchld;
+  sigemptyset(&sigchld);
+  sigaddset(&sigchld, SIGCHLD);
+  if (sigprocmask(SIG_BLOCK, &sigchld, &shell_sigmask) == -1){
+    err_and_ex("sigprocmask failed\n");
   }
-  if (signal(SIGINT, SIG_IGN) == SIG_ERR){
-    err_and_ex("signal failed\n");
+  // SIGINT only reaches the signalfd while the wait built-in command blocks it.
+  sigaddset(&sigchld, SIGINT);
+  struct epoll_event event;
+  if ((sigchld_fd = signalfd(-1, &sigchld, SFD_NONBLOCK | SFD_CLOEXEC)) == -1){
+    err_and_ex("signalfd failed\n");
   }
-  if (signal(SIGTSTP, SIG_IGN) == SIG_ERR){
-    err_and_ex("signal failed\n");
+  if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1){
+    err_and_ex("epoll_create1 failed\n");
   }
-  if (signal(SIGQUIT, SIG_IGN) == SIG_ERR){
-    err_and_ex("signal failed\n");
+  event.events = EPOLLIN;
+  event.data.u64 = EVENT_DATA(EVENT_SIGCHLD, sigchld_fd);
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sigchld_fd, &event) == -1){
+    err_and_ex("epoll_ctl failed\n");
   }
-  if (signal(SIGTTOU, SIG_IGN) == SIG_ERR){
-    err_and_ex("signal failed\n");
+  // A script is never waited on, so polling the epoll set between its lines is all it needs.
+  if (!script_mode){
+    event.data.u64 = EVENT_DATA(EVENT_STDIN, STDIN_FILENO);
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == 0){
+      stdin_watched = 1;
+      set_line_reader_wait(reader, wait_for_input);
+    } else if (errno != EPERM){
+      // EPERM means stdin is a regular file, which is always readable, so there is never
+      // anything to wait for.
+      err_and_ex("epoll_ctl failed\n");
+    }
   }
   while (!repl());
   return 0;
 }
-
-
-
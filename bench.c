@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// number of commands in each workload unless given on the command line
+#define _BENCH_N 1000
+// number of words after the command in a line of the long-argument workload
+#define _BENCH_ARGS 256
+// how many times jobs is run while the job table is full
+#define _BENCH_JOBS_RUNS 20
+// a command is given this long to finish before the benchmark gives up
+#define _BENCH_TIMEOUT_MS 10000
+
+// the shell prints nothing after most commands, so every command is followed
+// by pipesize, a builtin that prints the pipe size (0 unless changed) and is
+// cheap enough not to matter. The command has finished once that is printed
+#define _BENCH_MARKER_CMD "pipesize\n"
+#define _BENCH_MARKER "0\n"
+
+// a shell being benchmarked, fd is the master side of the terminal it runs
+// on, or the read end of the pipe its output goes to, in which case wfd is
+// the write end of the pipe its input comes from (otherwise the same as fd)
+// out holds what it printed since the last command was sent
+typedef struct shell {
+    pid_t pid;
+    int fd;
+    int wfd;
+    char out[65536];
+    size_t len;
+} shell_t;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+/*
+ * starts the shell on a terminal of its own, which it needs for job control.
+ * The terminal is raw, so lines of any length get through and nothing is
+ * echoed back
+ */
+static void start_shell(shell_t *sh, const char *path) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1) {
+        die("posix_openpt");
+    }
+    char *slave_name = ptsname(master);
+    if (slave_name == NULL) {
+        die("ptsname");
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+        die("fork");
+    }
+    if (pid == 0) {
+        setsid();
+        int slave = open(slave_name, O_RDWR);
+        if (slave == -1) {
+            die("open");
+        }
+        struct termios tio;
+        if (tcgetattr(slave, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(slave, TCSANOW, &tio);
+        }
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        if (slave > STDERR_FILENO) {
+            close(slave);
+        }
+        execl(path, path, (char *) NULL);
+        die(path);
+    }
+    sh->pid = pid;
+    sh->fd = master;
+    sh->wfd = master;
+    sh->len = 0;
+}
+
+/*
+ * starts the shell with pipes for its input and output and no terminal, the
+ * way it runs a batch of commands, without job control
+ */
+static void start_shell_pipes(shell_t *sh, const char *path) {
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) == -1 || pipe2(out, O_CLOEXEC) == -1) {
+        die("pipe2");
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+        die("fork");
+    }
+    if (pid == 0) {
+        // no controlling terminal either, so nothing can reach the terminal
+        // of the benchmark
+        setsid();
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(out[1], STDERR_FILENO);
+        execl(path, path, (char *) NULL);
+        die(path);
+    }
+    close(in[0]);
+    close(out[1]);
+    sh->pid = pid;
+    sh->fd = out[0];
+    sh->wfd = in[1];
+    sh->len = 0;
+}
+
+static void send_all(shell_t *sh, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(sh->wfd, buf, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            die("write");
+        }
+        buf += n;
+        len -= (size_t) n;
+    }
+}
+
+/* returns 1 once the marker has been printed on a line of its own */
+static int saw_marker(shell_t *sh) {
+    size_t mlen = strlen(_BENCH_MARKER);
+    for (size_t i = 0; i + mlen <= sh->len; i++) {
+        if ((i == 0 || sh->out[i - 1] == '\n')
+                && !memcmp(sh->out + i, _BENCH_MARKER, mlen)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * sends a line to the shell and waits for it to be executed,
+ * returns how long that took in nanoseconds
+ */
+static long long run_line(shell_t *sh, const char *line) {
+    sh->len = 0;
+    long long start = now_ns();
+    send_all(sh, line, strlen(line));
+    send_all(sh, "\n" _BENCH_MARKER_CMD, 1 + strlen(_BENCH_MARKER_CMD));
+    while (!saw_marker(sh)) {
+        struct pollfd pfd = { sh->fd, POLLIN, 0 };
+        int r = poll(&pfd, 1, _BENCH_TIMEOUT_MS);
+        if (r == 0) {
+            fprintf(stderr, "bench: no answer to: %.60s\n", line);
+            exit(1);
+        } else if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            die("poll");
+        }
+        // whatever does not fit is from earlier messages, only the end
+        // matters for finding the marker
+        if (sh->len > sizeof(sh->out) / 2) {
+            memmove(sh->out, sh->out + sh->len - 64, 64);
+            sh->len = 64;
+        }
+        ssize_t n = read(sh->fd, sh->out + sh->len, sizeof(sh->out) - sh->len);
+        if (n <= 0) {
+            fprintf(stderr, "bench: shell exited during: %.60s\n", line);
+            exit(1);
+        }
+        sh->len += (size_t) n;
+    }
+    return now_ns() - start;
+}
+
+static int cmp_ns(const void *a, const void *b) {
+    long long x = *(const long long *) a;
+    long long y = *(const long long *) b;
+    return (x > y) - (x < y);
+}
+
+/* prints the percentiles of the latencies of a workload and its rate */
+static void report(const char *name, long long *samples, int n, long long wall) {
+    qsort(samples, (size_t) n, sizeof(long long), cmp_ns);
+    printf("%-10s n=%-6d p50 %8.1fus  p90 %8.1fus  p99 %8.1fus  max %8.1fus  %9.1f cmds/s\n",
+        name, n,
+        (double) samples[n / 2] / 1e3,
+        (double) samples[n * 9 / 10] / 1e3,
+        (double) samples[n * 99 / 100] / 1e3,
+        (double) samples[n - 1] / 1e3,
+        wall > 0 ? (double) n * 1e9 / (double) wall : 0.0);
+    fflush(stdout);
+}
+
+/* runs the same line n times and reports how long each run took */
+static void workload(shell_t *sh, const char *name, const char *line, int n) {
+    long long *samples = malloc(sizeof(long long) * (size_t) n);
+    if (samples == NULL) {
+        die("malloc");
+    }
+    long long start = now_ns();
+    for (int i = 0; i < n; i++) {
+        samples[i] = run_line(sh, line);
+    }
+    report(name, samples, n, now_ns() - start);
+    free(samples);
+}
+
+/* runs every line in turn, n of them, and reports how long each run took */
+static void workload_lines(shell_t *sh, const char *name, char **lines, int nlines, int n) {
+    long long *samples = malloc(sizeof(long long) * (size_t) n);
+    if (samples == NULL) {
+        die("malloc");
+    }
+    long long start = now_ns();
+    for (int i = 0; i < n; i++) {
+        samples[i] = run_line(sh, lines[i % nlines]);
+    }
+    report(name, samples, n, now_ns() - start);
+    free(samples);
+}
+
+/*
+ * usage: bench [-p] shell [n]
+ * drives the shell through each workload, n commands apiece, and prints the
+ * latency percentiles and commands per second of every workload. With -p
+ * the shell runs on pipes instead of a terminal
+ */
+int main(int argc, char **argv) {
+    int use_pipes = argc > 1 && !strcmp(argv[1], "-p");
+    if (use_pipes) {
+        argc--;
+        argv++;
+    }
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: bench [-p] shell [n]\n");
+        return 1;
+    }
+    int n = argc == 3 ? atoi(argv[2]) : _BENCH_N;
+    if (n < 1) {
+        fprintf(stderr, "bench: n must be positive\n");
+        return 1;
+    }
+    // every background job holds a pidfd in the shell, so a deep job table
+    // needs as many descriptors as it can get
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    char dir[] = "/tmp/33bench.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        die("mkdtemp");
+    }
+
+    // the lines the shell records in its history are kept out of the user's
+    char hist[64];
+    snprintf(hist, sizeof(hist), "%s/history", dir);
+    setenv("HISTFILE", hist, 1);
+
+    shell_t *sh = malloc(sizeof(shell_t));
+    if (sh == NULL) {
+        die("malloc");
+    }
+    if (use_pipes) {
+        start_shell_pipes(sh, argv[1]);
+    } else {
+        start_shell(sh, argv[1]);
+    }
+    // the first line also waits for the shell to start up
+    run_line(sh, "");
+
+    workload(sh, "true", "/bin/true", n);
+
+    // a few kilobytes of arguments, which the shell splits into words and
+    // hands on to the program
+    size_t cap = 16 + _BENCH_ARGS * 33;
+    char *long_line = malloc(cap);
+    if (long_line == NULL) {
+        die("malloc");
+    }
+    strcpy(long_line, "/bin/true");
+    for (int i = 0; i < _BENCH_ARGS; i++) {
+        char word[40];
+        snprintf(word, sizeof(word), " argument-%04d-xxxxxxxxxxxxxxxxx", i);
+        strcat(long_line, word);
+    }
+    workload(sh, "longargs", long_line, n);
+    free(long_line);
+
+    // every line opens files for both its input and its output
+    char redir_lines[3][256];
+    snprintf(redir_lines[0], sizeof(redir_lines[0]), "/bin/echo bench > %s/a", dir);
+    snprintf(redir_lines[1], sizeof(redir_lines[1]), "/bin/cat < %s/a >> %s/b", dir, dir);
+    snprintf(redir_lines[2], sizeof(redir_lines[2]), "/bin/cat < %s/b > %s/c", dir, dir);
+    char *redir[3] = { redir_lines[0], redir_lines[1], redir_lines[2] };
+    workload_lines(sh, "redir", redir, 3, n);
+
+    // background jobs that outlive the benchmark fill up the job table, then
+    // listing them and running foreground jobs next to them is measured
+    workload(sh, "bg", "/bin/sleep 600 &", n);
+    workload(sh, "jobs", "jobs", _BENCH_JOBS_RUNS);
+    workload(sh, "deep-true", "/bin/true", n);
+
+    // exit kills the jobs that are left
+    send_all(sh, "exit\n", 5);
+    int status;
+    waitpid(sh->pid, &status, 0);
+    close(sh->fd);
+    if (sh->wfd != sh->fd) {
+        close(sh->wfd);
+    }
+    free(sh);
+
+    char path[64];
+    const char *names[] = { "a", "b", "c", "history" };
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        unlink(path);
+    }
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include "./fdcache.h"
+
+// a file redirected to: its path, whether it is appended to or read, how
+// many times it was, the descriptor, -1 until it is opened, the device and
+// inode of the file opened and how many times the descriptor was reused
+// last is when the entry was last used, on the clock of the cache, and
+// user the process a descriptor for reading was last handed to, 0 if none
+struct fd_entry {
+    char *path;
+    int append;
+    unsigned long uses;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    unsigned long hits;
+    unsigned long last;
+    pid_t user;
+};
+typedef struct fd_entry fd_entry_t;
+
+// the entries are few enough to be looked through one by one, the first
+// count of them are in use
+// clock counts the lookups, so the entry used least recently has the
+// smallest last
+struct fd_cache {
+    fd_entry_t entries[_FD_CACHE_SIZE];
+    size_t count;
+    unsigned long clock;
+};
+
+/* closes the file of an entry, if it is open */
+static void close_entry(fd_entry_t *entry) {
+    if (entry->fd != -1) {
+        close(entry->fd);
+        entry->fd = -1;
+    }
+    entry->user = 0;
+}
+
+/* initializes the redirection cache, returns pointer */
+fd_cache_t *init_fd_cache() {
+    fd_cache_t *cache = (fd_cache_t *) calloc(1, sizeof(fd_cache_t));
+    return cache;
+}
+
+/* cleans up the cache, closing every file it has open */
+void cleanup_fd_cache(fd_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    clear_fd_cache(cache);
+    free(cache);
+}
+
+/* forgets every file, closing the ones open */
+void clear_fd_cache(fd_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < cache->count; i++) {
+        close_entry(&cache->entries[i]);
+        free(cache->entries[i].path);
+    }
+    cache->count = 0;
+}
+
+/* finds the entry of a file, making one if there is none, NULL on failure */
+static fd_entry_t *find_entry(fd_cache_t *cache, const char *path, int append) {
+    for (size_t i = 0; i < cache->count; i++) {
+        fd_entry_t *entry = &cache->entries[i];
+        if (entry->append == append && !strcmp(entry->path, path)) {
+            return entry;
+        }
+    }
+    char *copy = strdup(path);
+    if (copy == NULL) {
+        return NULL;
+    }
+    fd_entry_t *entry;
+    if (cache->count < _FD_CACHE_SIZE) {
+        entry = &cache->entries[cache->count++];
+    } else {
+        entry = &cache->entries[0];
+        for (size_t i = 1; i < cache->count; i++) {
+            if (cache->entries[i].last < entry->last) {
+                entry = &cache->entries[i];
+            }
+        }
+        close_entry(entry);
+        free(entry->path);
+    }
+    memset(entry, 0, sizeof(fd_entry_t));
+    entry->path = copy;
+    entry->append = append;
+    entry->fd = -1;
+    return entry;
+}
+
+/* gets a descriptor for a redirection to or from the file at path */
+int get_redir_fd(fd_cache_t *cache, const char *path, int append) {
+    if (cache == NULL) {
+        return -1;
+    }
+    fd_entry_t *entry = find_entry(cache, path, append);
+    if (entry == NULL) {
+        return -1;
+    }
+    entry->last = ++cache->clock;
+    if (++entry->uses < _FD_CACHE_MIN_USES) {
+        return -1;
+    }
+    // a pid that was reused only makes the file be opened as usual
+    if (entry->user && kill(entry->user, 0) == 0) {
+        return -1;
+    }
+    entry->user = 0;
+    // fifos and devices could block in open, and are left to the child
+    struct stat st;
+    if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close_entry(entry);
+        return -1;
+    }
+    if (entry->fd != -1 && (st.st_dev != entry->dev || st.st_ino != entry->ino)) {
+        close_entry(entry);
+    }
+    if (entry->fd == -1) {
+        int flags = append ? O_WRONLY | O_APPEND | O_CREAT : O_RDONLY;
+        entry->fd = open(path, flags | O_CLOEXEC, 0666);
+        if (entry->fd == -1) {
+            return -1;
+        }
+        // the file opened, in case it was replaced since the stat
+        if (fstat(entry->fd, &st) == -1) {
+            close_entry(entry);
+            return -1;
+        }
+        entry->dev = st.st_dev;
+        entry->ino = st.st_ino;
+    } else {
+        entry->hits++;
+    }
+    if (!append && lseek(entry->fd, 0, SEEK_SET) == -1) {
+        close_entry(entry);
+        return -1;
+    }
+    return entry->fd;
+}
+
+/* records the process a descriptor for reading was handed to */
+void set_redir_fd_user(fd_cache_t *cache, int fd, pid_t pid) {
+    if (cache == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < cache->count; i++) {
+        if (cache->entries[i].fd == fd && !cache->entries[i].append) {
+            cache->entries[i].user = pid;
+        }
+    }
+}
+
+/* fdcache command, prints out the files kept open and their hits */
+void print_fd_cache(fd_cache_t *cache) {
+    if (cache == NULL) {
+        printf("fdcache: off\n");
+        return;
+    }
+    int empty = 1;
+    for (size_t i = 0; i < cache->count; i++) {
+        fd_entry_t *entry = &cache->entries[i];
+        if (entry->fd == -1) {
+            continue;
+        }
+        if (empty) {
+            printf("hits\tfd\tfile\n");
+            empty = 0;
+        }
+        printf("%4lu\t%d\t%s %s\n", entry->hits, entry->fd, entry->append ? ">>" : "<", entry->path);
+    }
+    if (empty) {
+        printf("fdcache: no files open\n");
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef FDCACHE_H_
+#define FDCACHE_H_
+
+#include <unistd.h>
+#include <sys/types.h>
+
+// number of files the cache knows of, the one used least recently is
+// forgotten, and closed, to make room for another
+#define _FD_CACHE_SIZE 32
+// how many times a file must be redirected to before it is kept open
+#define _FD_CACHE_MIN_USES 2
+
+typedef struct fd_cache fd_cache_t;
+
+/* initializes the redirection cache, returns pointer */
+fd_cache_t *init_fd_cache();
+/*
+ * cleans up the cache, closing every file it has open
+ * Note: this function will free the cache pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_fd_cache(fd_cache_t *cache);
+
+/*
+ * gets a descriptor for a redirection that appends to the regular file at
+ * path (>>), or reads it (<). Once a file has been redirected to
+ * _FD_CACHE_MIN_USES times it is kept open, close-on-exec, to be dup2'ed
+ * onto stdin or stdout. Every time, path is stat'ed first and must still
+ * be the file that was opened, by device and inode, or it is opened again,
+ * so a file that was rotated, removed or that path means something else
+ * after cd is never used. A descriptor for reading is put back at the start
+ * of the file, and is not handed out while the process it was last handed
+ * to is alive, since they would share the offset
+ * returns the descriptor, -1 if the redirection is to be opened as usual
+ */
+int get_redir_fd(fd_cache_t *cache, const char *path, int append);
+
+/* records the process a descriptor for reading was handed to */
+void set_redir_fd_user(fd_cache_t *cache, int fd, pid_t pid);
+
+/* forgets every file, closing the ones open */
+void clear_fd_cache(fd_cache_t *cache);
+
+/* fdcache command, prints out the files kept open and their hits */
+void print_fd_cache(fd_cache_t *cache);
+
+#endif  // FDCACHE_H_
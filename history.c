@@ -0,0 +1,351 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "./history.h"
+
+// number of buckets three-character sequences are hashed into, must be a
+// power of two
+#define _HIST_BUCKET_BITS 16
+#define _HIST_BUCKETS (1 << _HIST_BUCKET_BITS)
+
+// map is the file as it was when the history was initialized, and mem holds
+// the lines added since, each followed by a newline, of which the first
+// flushed bytes have been written to the file
+// lines holds where each line starts, in map for the first nmapped and in
+// mem for the rest. It is only filled in once a line is first asked for,
+// until then loaded is 0; mapped_end is where the last mapped line ends
+// the index lists, for every bucket, the lines before nindexed that have a
+// sequence hashing to it, oldest first: those of bucket b are ids[starts[b]]
+// up to ids[starts[b + 1]]. A line is indexed as if it started with a
+// newline, so the sequences at its start are told apart from the others
+struct history {
+    int fd;
+    char *map;
+    size_t map_len;
+    char *mem;
+    size_t mem_len;
+    size_t mem_cap;
+    size_t flushed;
+    int loaded;
+    size_t *lines;
+    size_t nlines;
+    size_t lines_cap;
+    size_t nmapped;
+    size_t mapped_end;
+    uint32_t *starts;
+    uint32_t *ids;
+    size_t nindexed;
+};
+
+/* bucket of a sequence of three characters, packed into the low 24 bits */
+static uint32_t trigram_bucket(uint32_t w) {
+    return (uint32_t) (w * 2654435761u) >> (32 - _HIST_BUCKET_BITS);
+}
+
+/* initializes the history kept in the file at path, returns pointer */
+history_t *init_history(const char *path) {
+    history_t *hist = (history_t *) calloc(1, sizeof(history_t));
+    if (hist == NULL) {
+        return NULL;
+    }
+    hist->fd = -1;
+    if (path == NULL) {
+        return hist;
+    }
+    hist->fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (hist->fd == -1) {
+        return hist;
+    }
+    // the file is mapped as it is now, lines added later are kept in mem
+    struct stat st;
+    if (fstat(hist->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, hist->fd, 0);
+        if (map != MAP_FAILED) {
+            hist->map = (char *) map;
+            hist->map_len = (size_t) st.st_size;
+            // a file whose last line has no newline would have the first line
+            // added run into it, the last line ends where the mapping does
+            if (hist->map[hist->map_len - 1] != '\n') {
+                while (write(hist->fd, "\n", 1) == -1 && errno == EINTR) {
+                }
+            }
+        }
+    }
+    return hist;
+}
+
+/* writes out the lines that are waiting, returns 0 on success, -1 on failure */
+int flush_history(history_t *hist) {
+    if (hist->fd == -1) {
+        hist->flushed = hist->mem_len;
+        return 0;
+    }
+    while (hist->flushed < hist->mem_len) {
+        ssize_t n = write(hist->fd, hist->mem + hist->flushed, hist->mem_len - hist->flushed);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        hist->flushed += (size_t) n;
+    }
+    return 0;
+}
+
+/* cleans up the history */
+void cleanup_history(history_t *hist) {
+    flush_history(hist);
+    if (hist->map != NULL) {
+        munmap(hist->map, hist->map_len);
+    }
+    if (hist->fd != -1) {
+        close(hist->fd);
+    }
+    free(hist->mem);
+    free(hist->lines);
+    free(hist->starts);
+    free(hist->ids);
+    free(hist);
+}
+
+/* remembers that a line starts at off, returns 0 on success, -1 on failure */
+static int push_line(history_t *hist, size_t off) {
+    if (hist->nlines == hist->lines_cap) {
+        size_t cap = hist->lines_cap ? hist->lines_cap * 2 : 1024;
+        size_t *lines = (size_t *) realloc(hist->lines, cap * sizeof(size_t));
+        if (lines == NULL) {
+            return -1;
+        }
+        hist->lines = lines;
+        hist->lines_cap = cap;
+    }
+    hist->lines[hist->nlines++] = off;
+    return 0;
+}
+
+/*
+ * finds where every line starts, the first time a line is asked for
+ * returns 0 on success, -1 on failure
+ */
+static int load_history(history_t *hist) {
+    if (hist->loaded) {
+        return 0;
+    }
+    size_t pos = 0;
+    while (pos < hist->map_len) {
+        if (push_line(hist, pos) == -1) {
+            return -1;
+        }
+        char *nl = memchr(hist->map + pos, '\n', hist->map_len - pos);
+        hist->mapped_end = nl != NULL ? (size_t) (nl - hist->map) : hist->map_len;
+        pos = hist->mapped_end + 1;
+    }
+    hist->nmapped = hist->nlines;
+    for (pos = 0; pos < hist->mem_len; ) {
+        if (push_line(hist, pos) == -1) {
+            return -1;
+        }
+        pos = (size_t) ((char *) memchr(hist->mem + pos, '\n', hist->mem_len - pos) - hist->mem) + 1;
+    }
+    hist->loaded = 1;
+    return 0;
+}
+
+/* adds a line to the end of the history, returns 0 on success, -1 on failure */
+int add_history(history_t *hist, const char *line, size_t len) {
+    if (hist->mem_len + len + 1 > hist->mem_cap) {
+        size_t cap = hist->mem_cap ? hist->mem_cap : _HIST_FLUSH_LEN;
+        while (cap < hist->mem_len + len + 1) {
+            cap *= 2;
+        }
+        char *mem = (char *) realloc(hist->mem, cap);
+        if (mem == NULL) {
+            return -1;
+        }
+        hist->mem = mem;
+        hist->mem_cap = cap;
+    }
+    if (hist->loaded && push_line(hist, hist->mem_len) == -1) {
+        return -1;
+    }
+    memcpy(hist->mem + hist->mem_len, line, len);
+    hist->mem[hist->mem_len + len] = '\n';
+    hist->mem_len += len + 1;
+    // a failed write is tried again with the next line
+    if (hist->mem_len - hist->flushed >= _HIST_FLUSH_LEN) {
+        flush_history(hist);
+    }
+    return 0;
+}
+
+/* returns the number of lines in the history */
+size_t count_history(history_t *hist) {
+    if (load_history(hist) == -1) {
+        return 0;
+    }
+    return hist->nlines;
+}
+
+/* returns line i of the history and stores its length in len */
+const char *get_history(history_t *hist, size_t i, size_t *len) {
+    size_t start = hist->lines[i];
+    if (i < hist->nmapped) {
+        size_t end = i + 1 < hist->nmapped ? hist->lines[i + 1] - 1 : hist->mapped_end;
+        *len = end - start;
+        return hist->map + start;
+    }
+    size_t end = i + 1 < hist->nlines ? hist->lines[i + 1] : hist->mem_len;
+    *len = end - 1 - start;
+    return hist->mem + start;
+}
+
+/*
+ * indexes every line there is, in two passes over them, one counting the
+ * lines in each bucket and one filling them in. A line is listed once in a
+ * bucket however many of its sequences hash to it
+ * returns 0 on success, -1 on failure
+ */
+static int build_index(history_t *hist) {
+    uint32_t *starts = (uint32_t *) calloc(_HIST_BUCKETS + 1, sizeof(uint32_t));
+    uint32_t *last = (uint32_t *) calloc(_HIST_BUCKETS, sizeof(uint32_t));
+    uint32_t *fill = (uint32_t *) malloc(_HIST_BUCKETS * sizeof(uint32_t));
+    uint32_t *ids = NULL;
+    if (starts == NULL || last == NULL || fill == NULL || hist->nlines >= UINT32_MAX) {
+        goto fail;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < hist->nlines; i++) {
+            size_t len;
+            const unsigned char *line = (const unsigned char *) get_history(hist, i, &len);
+            uint32_t w = '\n';
+            for (size_t k = 0; k < len; k++) {
+                w = ((w << 8) | line[k]) & 0xffffff;
+                if (k < 1) {
+                    continue;
+                }
+                uint32_t b = trigram_bucket(w);
+                // lines are numbered from 1 here, so 0 means none yet
+                if (last[b] == i + 1) {
+                    continue;
+                }
+                last[b] = (uint32_t) (i + 1);
+                if (pass == 0) {
+                    starts[b + 1]++;
+                } else {
+                    ids[fill[b]++] = (uint32_t) i;
+                }
+            }
+        }
+        if (pass == 0) {
+            uint64_t total = 0;
+            for (size_t b = 0; b < _HIST_BUCKETS; b++) {
+                total += starts[b + 1];
+                if (total > UINT32_MAX) {
+                    goto fail;
+                }
+                starts[b + 1] = (uint32_t) total;
+                fill[b] = starts[b];
+            }
+            ids = (uint32_t *) malloc((size_t) (total ? total : 1) * sizeof(uint32_t));
+            if (ids == NULL) {
+                goto fail;
+            }
+            memset(last, 0, _HIST_BUCKETS * sizeof(uint32_t));
+        }
+    }
+    free(hist->starts);
+    free(hist->ids);
+    hist->starts = starts;
+    hist->ids = ids;
+    hist->nindexed = hist->nlines;
+    free(last);
+    free(fill);
+    return 0;
+fail:
+    free(starts);
+    free(last);
+    free(fill);
+    free(ids);
+    return -1;
+}
+
+/* returns 1 if line i contains text, or starts with it if prefix is set */
+static int line_matches(history_t *hist, size_t i, const char *text, size_t len, int prefix) {
+    size_t line_len;
+    const char *line = get_history(hist, i, &line_len);
+    if (prefix) {
+        return line_len >= len && !memcmp(line, text, len);
+    }
+    return len == 0 || memmem(line, line_len, text, len) != NULL;
+}
+
+/* finds the newest line before line before that contains or starts with text */
+long find_history(history_t *hist, const char *text, size_t len, int prefix, size_t before) {
+    if (load_history(hist) == -1) {
+        return -1;
+    }
+    if (hist->nlines - hist->nindexed > _HIST_REINDEX) {
+        // if there is not enough memory, the lines are searched one by one
+        build_index(hist);
+    }
+    if (before > hist->nlines) {
+        before = hist->nlines;
+    }
+    // lines newer than the index come first
+    size_t i = before;
+    while (i > hist->nindexed) {
+        i--;
+        if (line_matches(hist, i, text, len, prefix)) {
+            return (long) i;
+        }
+    }
+    // text is too short to have sequences to look up
+    if (hist->nindexed == 0 || len < (prefix ? 2 : 3)) {
+        while (i > 0) {
+            i--;
+            if (line_matches(hist, i, text, len, prefix)) {
+                return (long) i;
+            }
+        }
+        return -1;
+    }
+    // every sequence of text must be in the line, so only the lines in the
+    // smallest bucket of any of them are looked at
+    const unsigned char *t = (const unsigned char *) text;
+    uint32_t w = prefix ? '\n' : 0;
+    uint32_t best = 0;
+    uint32_t best_len = UINT32_MAX;
+    for (size_t k = 0; k < len; k++) {
+        w = ((w << 8) | t[k]) & 0xffffff;
+        if (k < (prefix ? 1u : 2u)) {
+            continue;
+        }
+        uint32_t b = trigram_bucket(w);
+        if (hist->starts[b + 1] - hist->starts[b] < best_len) {
+            best = b;
+            best_len = hist->starts[b + 1] - hist->starts[b];
+        }
+    }
+    // the bucket is in order, so the lines before i are found by bisection
+    size_t lo = hist->starts[best];
+    size_t hi = hist->starts[best + 1];
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (hist->ids[mid] < i) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (size_t j = lo; j > hist->starts[best]; j--) {
+        if (line_matches(hist, hist->ids[j - 1], text, len, prefix)) {
+            return (long) hist->ids[j - 1];
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,60 @@
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <unistd.h>
+#include <sys/types.h>
+
+// lines added to the history are written to its file once this many bytes
+// of them are waiting, when flush_history is called and when the history
+// is cleaned up
+#define _HIST_FLUSH_LEN 4096
+// the index is rebuilt once this many lines were added since it was built,
+// lines newer than the index are searched one by one
+#define _HIST_REINDEX 1024
+
+typedef struct history history_t;
+
+/*
+ * initializes the history, whose lines are kept in the file at path, one
+ * per line. The file is mapped but not read, so this costs the same however
+ * long the history is, and a newline is added to it if its last line has
+ * none. If path is NULL or cannot be opened, the history lasts as long as
+ * the shell does
+ * returns pointer, NULL on failure
+ */
+history_t *init_history(const char *path);
+/*
+ * writes out the lines that are still waiting and cleans up the history
+ * Note: this function will free the history pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_history(history_t *hist);
+
+/*
+ * adds a line of len characters, which has no newline, to the end of the
+ * history. It is written to the file with the lines after it, in one write
+ * returns 0 on success, -1 on failure
+ */
+int add_history(history_t *hist, const char *line, size_t len);
+
+/* writes out the lines that are waiting, returns 0 on success, -1 on failure */
+int flush_history(history_t *hist);
+
+/* returns the number of lines in the history */
+size_t count_history(history_t *hist);
+
+/*
+ * returns line i of the history, the oldest being 0, and stores its length
+ * in len. The line is not null terminated
+ */
+const char *get_history(history_t *hist, size_t i, size_t *len);
+
+/*
+ * finds the newest line before line before that contains text, which is
+ * len characters long, or that starts with it if prefix is set. Lines are
+ * looked up through an index of the three-character sequences in them
+ * returns the line, -1 if there is none
+ */
+long find_history(history_t *hist, const char *text, size_t len, int prefix, size_t before);
+
+#endif  // HISTORY_H_
@@ -1,31 +1,500 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
+#include <sys/syscall.h>
 #include "./jobs.h"
 
+// initial number of buckets in each index, must be a power of two
+#define _JOB_BUCKETS_INIT 64
+// number of job records carved out of each slab
+#define _JOB_SLAB_SLOTS 64
+// commands up to this length (including the null character) are stored
+// inside the job record itself instead of in a separate allocation
+#define _JOB_CMD_INLINE 48
+// number of finished jobs whose resource usage is kept for jobs -l
+#define _JOB_DONE_KEEP 32
+// initial number of 64-bit words in the bitmap of jids in use, must be a
+// multiple of 64 so that every bit of the summary stands for a word
+#define _JOB_JID_WORDS_INIT 64
+
+// the resource usage of a process, or the sum over the processes of a job,
+// cpu times are in microseconds and maxrss in kilobytes
+struct job_usage {
+    long long utime;
+    long long stime;
+    long maxrss;
+    long minflt;
+    long majflt;
+    long nvcsw;
+    long nivcsw;
+};
+typedef struct job_usage job_usage_t;
+
+// a process belonging to a job, most jobs have just one but a pipeline
+// has one per stage. chain links the process into its bucket of the pid
+// index and next to the next process of the same job
+// pidfd refers to the process itself rather than to its pid, which could
+// be reused by an unrelated process, it is -1 until set and once done
+// usage is what the process had used when it last stopped or when it
+// finished, all zero until then, and status how it finished: its exit
+// status, or 128 plus the signal that terminated it, 0 until then, with
+// the signal in sig, 0 if it exited
+struct job_process {
+    pid_t pid;
+    int pidfd;
+    int done;
+    int status;
+    int sig;
+    job_usage_t usage;
+    struct job_element *job;
+    struct job_process *chain;
+    struct job_process *next;
+};
+typedef struct job_process job_process_t;
+
+// every job lives on three lists at once:
+// next/prev keep the jobs in insertion order for printing and iterating,
+// jid_chain links the job into its bucket of the jid index and its
+// processes are linked into the pid index, so that lookups never have to
+// walk the whole list
+// the job's first process is its leader, whose pid is the pid of the job
+// and the id of the process group all its processes are in
+// state always points at one of the interned state strings below and
+// command points at command_buf unless the command was too long for it
+// while a record sits on the free list of the slabs, next links it there
+// launch describes the settings the job was launched with by run, NULL if
+// it was launched without any, and foreground is set while the shell waits
+// for the job rather than leaving it in the background
 struct job_element {
     int jid;
-    pid_t pid;
+    int running;
+    int foreground;
     process_state_t state;
     char *command;
+    char *launch;
     struct job_element *next;
+    struct job_element *prev;
+    struct job_element *jid_chain;
+    job_process_t leader;
+    char command_buf[_JOB_CMD_INLINE];
 };
 typedef struct job_element job_element_t;
 
-// head is the head of the list
+// job records are handed out from slabs of _JOB_SLAB_SLOTS records,
+// slabs are only given back to malloc when the job list is cleaned up
+struct job_slab {
+    struct job_slab *next;
+    job_element_t slots[_JOB_SLAB_SLOTS];
+};
+typedef struct job_slab job_slab_t;
+
+// what is kept of a job once it has been removed from the list
+struct job_done {
+    int jid;
+    pid_t pid;
+    int status;
+    int sig;
+    int foreground;
+    char command[_JOB_CMD_INLINE];
+    job_usage_t usage;
+};
+typedef struct job_done job_done_t;
+
+// the only states a job can be in, jobs point at these instead of
+// carrying their own copy so that stopping and continuing a job is free
+static char state_running[] = _STATE_RUNNING;
+static char state_stopped[] = _STATE_STOPPED;
+
+// head and tail are the ends of the ordered list
 // current is the current element being iterated over
+// jid_table and pid_table are the bucket arrays of the two indexes,
+// both have nbuckets entries and are resized together
+// slabs holds every slab allocated so far and free_jobs the records in them
+// that are not in use
+// done is a ring of the last _JOB_DONE_KEEP jobs removed, ndone counts every
+// job ever removed so the oldest one is at ndone % _JOB_DONE_KEEP once full
+// jid_bits has a bit set for every jid in use, jid 0 included so it is never
+// handed out, and jid_full a bit set for every word of jid_bits that is full,
+// so the lowest free jid is found with two count-trailing-zeros
+// plus_jid and minus_jid are the jids of the jobs %+ and %- refer to, 0 for
+// none: the job most recently started or changed, and the one before
 struct job_list {
     job_element_t *head;
+    job_element_t *tail;
     job_element_t *current;
+    job_element_t **jid_table;
+    job_process_t **pid_table;
+    size_t nbuckets;
+    size_t count;
+    job_slab_t *slabs;
+    job_element_t *free_jobs;
+    job_done_t done[_JOB_DONE_KEEP];
+    size_t ndone;
+    uint64_t *jid_bits;
+    uint64_t *jid_full;
+    size_t jid_words;
+    int plus_jid;
+    int minus_jid;
     pid_t shell_pid;
 };
 
+/*
+ * maps a state onto its interned string
+ * returns NULL if the state is not one a job can be in
+ */
+static process_state_t intern_state(process_state_t state) {
+    if (state == state_running || !strcmp(state, _STATE_RUNNING)) {
+        return state_running;
+    }
+    if (state == state_stopped || !strcmp(state, _STATE_STOPPED)) {
+        return state_stopped;
+    }
+    return NULL;
+}
+
+/* takes a job record off the free list, allocating a new slab if it is empty */
+static job_element_t *alloc_job(job_list_t *job_list) {
+    if (job_list->free_jobs == NULL) {
+        job_slab_t *slab = (job_slab_t *) malloc(sizeof(job_slab_t));
+        if (slab == NULL) {
+            return NULL;
+        }
+        slab->next = job_list->slabs;
+        job_list->slabs = slab;
+        for (int i = _JOB_SLAB_SLOTS - 1; i >= 0; i--) {
+            slab->slots[i].next = job_list->free_jobs;
+            job_list->free_jobs = &slab->slots[i];
+        }
+    }
+    job_element_t *job = job_list->free_jobs;
+    job_list->free_jobs = job->next;
+    return job;
+}
+
+/* closes the pidfd of a process, if it has one */
+static void close_pidfd(job_process_t *proc) {
+    if (proc->pidfd != -1) {
+        close(proc->pidfd);
+        proc->pidfd = -1;
+    }
+}
+
+/*
+ * sends a signal to every process of a job that has not finished, through
+ * its pidfd, or to the job's process group for processes without one
+ * returns 0 on success, -1 on failure
+ */
+static int send_job_signal(job_element_t *job, int sig) {
+    int ret = 0;
+    int group = 0;
+    for (job_process_t *proc = &job->leader; proc != NULL; proc = proc->next) {
+        if (proc->done) {
+            continue;
+        }
+        if (proc->pidfd == -1) {
+            group = 1;
+        } else if (syscall(SYS_pidfd_send_signal, proc->pidfd, sig, NULL, 0) == -1
+                && errno != ESRCH) {
+            // ESRCH means the process has exited but not been reaped yet
+            ret = -1;
+        }
+    }
+    if (group && kill(-job->leader.pid, sig) == -1) {
+        ret = -1;
+    }
+    return ret;
+}
+
+/* gives a job record back to the free list */
+static void free_job(job_list_t *job_list, job_element_t *job) {
+    close_pidfd(&job->leader);
+    job_process_t *proc = job->leader.next;
+    while (proc != NULL) {
+        job_process_t *next = proc->next;
+        close_pidfd(proc);
+        free(proc);
+        proc = next;
+    }
+    job->leader.next = NULL;
+    if (job->command != job->command_buf) {
+        free(job->command);
+    }
+    free(job->launch);
+    job->launch = NULL;
+    job->command = NULL;
+    job->state = NULL;
+    job->next = job_list->free_jobs;
+    job_list->free_jobs = job;
+}
+
+/* bucket of a jid, jids are small and dense so the low bits will do */
+static size_t jid_bucket(job_list_t *job_list, int jid) {
+    return (size_t) (unsigned int) jid & (job_list->nbuckets - 1);
+}
+
+/* bucket of a pid, pids are handed out in runs so they get mixed first */
+static size_t pid_bucket(job_list_t *job_list, pid_t pid) {
+    unsigned int h = (unsigned int) pid * 2654435761u;
+    return (size_t) (h ^ (h >> 16)) & (job_list->nbuckets - 1);
+}
+
+/* finds the job with the given JID, returns NULL if there is none */
+static job_element_t *find_job_jid(job_list_t *job_list, int jid) {
+    job_element_t *cur = job_list->jid_table[jid_bucket(job_list, jid)];
+    while (cur != NULL && cur->jid != jid) {
+        cur = cur->jid_chain;
+    }
+    return cur;
+}
+
+/* finds the process with the given PID, returns NULL if there is none */
+static job_process_t *find_process(job_list_t *job_list, pid_t pid) {
+    job_process_t *cur = job_list->pid_table[pid_bucket(job_list, pid)];
+    while (cur != NULL && cur->pid != pid) {
+        cur = cur->chain;
+    }
+    return cur;
+}
+
+/* finds the job one of whose processes has the given PID, returns NULL if there is none */
+static job_element_t *find_job_pid(job_list_t *job_list, pid_t pid) {
+    job_process_t *proc = find_process(job_list, pid);
+    return proc != NULL ? proc->job : NULL;
+}
+
+/* links a process into its bucket of the pid index */
+static void index_process(job_list_t *job_list, job_process_t *proc) {
+    size_t pb = pid_bucket(job_list, proc->pid);
+    proc->chain = job_list->pid_table[pb];
+    job_list->pid_table[pb] = proc;
+}
+
+/* unlinks a process from its bucket of the pid index */
+static void unindex_process(job_list_t *job_list, job_process_t *proc) {
+    job_process_t **link = &job_list->pid_table[pid_bucket(job_list, proc->pid)];
+    while (*link != proc) {
+        link = &(*link)->chain;
+    }
+    *link = proc->chain;
+}
+
+/*
+ * links a job into the buckets of both indexes, finished processes other
+ * than the leader are left out, their pids may already belong to others
+ */
+static void index_job(job_list_t *job_list, job_element_t *job) {
+    size_t jb = jid_bucket(job_list, job->jid);
+    job->jid_chain = job_list->jid_table[jb];
+    job_list->jid_table[jb] = job;
+    for (job_process_t *proc = &job->leader; proc != NULL; proc = proc->next) {
+        if (proc == &job->leader || !proc->done) {
+            index_process(job_list, proc);
+        }
+    }
+}
+
+/*
+ * doubles the number of buckets once the indexes get crowded
+ * returns 0 on success, -1 if the new tables could not be allocated,
+ * in which case the old (slower but still correct) tables are kept
+ */
+static int grow_indexes(job_list_t *job_list) {
+    size_t nbuckets = job_list->nbuckets * 2;
+    job_element_t **jid_table = calloc(nbuckets, sizeof(job_element_t *));
+    job_process_t **pid_table = calloc(nbuckets, sizeof(job_process_t *));
+    if (jid_table == NULL || pid_table == NULL) {
+        free(jid_table);
+        free(pid_table);
+        return -1;
+    }
+    free(job_list->jid_table);
+    free(job_list->pid_table);
+    job_list->jid_table = jid_table;
+    job_list->pid_table = pid_table;
+    job_list->nbuckets = nbuckets;
+
+    // rehash walking the ordered list, which holds every job exactly once
+    for (job_element_t *cur = job_list->head; cur != NULL; cur = cur->next) {
+        index_job(job_list, cur);
+    }
+    return 0;
+}
+
+/*
+ * marks a jid as in use or not, growing the bitmap if it is too small
+ * returns 0 on success, -1 on failure
+ */
+static int mark_jid(job_list_t *job_list, int jid, int used) {
+    size_t w = (size_t) jid / 64;
+    if (w >= job_list->jid_words) {
+        if (!used) {
+            return 0;
+        }
+        size_t words = job_list->jid_words;
+        while (words <= w) {
+            words *= 2;
+        }
+        uint64_t *bits = realloc(job_list->jid_bits, words * sizeof(uint64_t));
+        if (bits == NULL) {
+            return -1;
+        }
+        job_list->jid_bits = bits;
+        uint64_t *full = realloc(job_list->jid_full, words / 64 * sizeof(uint64_t));
+        if (full == NULL) {
+            return -1;
+        }
+        job_list->jid_full = full;
+        memset(bits + job_list->jid_words, 0, (words - job_list->jid_words) * sizeof(uint64_t));
+        memset(full + job_list->jid_words / 64, 0,
+            (words - job_list->jid_words) / 64 * sizeof(uint64_t));
+        job_list->jid_words = words;
+    }
+    uint64_t bit = (uint64_t) 1 << (jid % 64);
+    if (used) {
+        job_list->jid_bits[w] |= bit;
+    } else {
+        job_list->jid_bits[w] &= ~bit;
+    }
+    uint64_t full = (uint64_t) 1 << (w % 64);
+    if (job_list->jid_bits[w] == UINT64_MAX) {
+        job_list->jid_full[w / 64] |= full;
+    } else {
+        job_list->jid_full[w / 64] &= ~full;
+    }
+    return 0;
+}
+
+/* makes a job the one %+ refers to, and the one that was the one %- refers to */
+static void touch_job(job_list_t *job_list, int jid) {
+    if (job_list->plus_jid != jid) {
+        job_list->minus_jid = job_list->plus_jid;
+        job_list->plus_jid = jid;
+    }
+}
+
+/* adds up the usage of every process of a job, maxrss is the largest one */
+static void sum_job_usage(job_element_t *job, job_usage_t *usage) {
+    memset(usage, 0, sizeof(job_usage_t));
+    for (job_process_t *proc = &job->leader; proc != NULL; proc = proc->next) {
+        usage->utime += proc->usage.utime;
+        usage->stime += proc->usage.stime;
+        if (proc->usage.maxrss > usage->maxrss) {
+            usage->maxrss = proc->usage.maxrss;
+        }
+        usage->minflt += proc->usage.minflt;
+        usage->majflt += proc->usage.majflt;
+        usage->nvcsw += proc->usage.nvcsw;
+        usage->nivcsw += proc->usage.nivcsw;
+    }
+}
+
+/* the status of a job is that of its last process, as for a pipeline */
+static job_process_t *last_process(job_element_t *job) {
+    job_process_t *proc = &job->leader;
+    while (proc->next != NULL) {
+        proc = proc->next;
+    }
+    return proc;
+}
+
+/*
+ * writes how a finished job ended into buf, as bash does: Done, Exit and the
+ * status, or the name of the signal that terminated it
+ */
+static void format_done(const job_done_t *done, char *buf, size_t len) {
+    if (done->sig) {
+        snprintf(buf, len, "%s", strsignal(done->sig));
+    } else if (done->status) {
+        snprintf(buf, len, "Exit %d", done->status);
+    } else {
+        snprintf(buf, len, "Done");
+    }
+}
+
+/* prints the usage of a job on the line below it, returns printf's result */
+static int print_job_usage(job_usage_t *usage) {
+    return printf("\tuser %lld.%06llds sys %lld.%06llds maxrss %ldKB "
+            "faults %ld/%ld switches %ld/%ld\n",
+            usage->utime / 1000000, usage->utime % 1000000,
+            usage->stime / 1000000, usage->stime % 1000000,
+            usage->maxrss, usage->majflt, usage->minflt,
+            usage->nvcsw, usage->nivcsw);
+}
+
+/* unlinks a job from the ordered list and both indexes and frees it */
+static void unlink_job(job_list_t *job_list, job_element_t *job) {
+    // the job is gone but its usage is kept for jobs -l
+    job_done_t *done = &job_list->done[job_list->ndone % _JOB_DONE_KEEP];
+    job_list->ndone++;
+    done->jid = job->jid;
+    done->pid = job->leader.pid;
+    done->status = last_process(job)->status;
+    done->sig = last_process(job)->sig;
+    done->foreground = job->foreground;
+    strncpy(done->command, job->command, _JOB_CMD_INLINE - 1);
+    done->command[_JOB_CMD_INLINE - 1] = 0;
+    sum_job_usage(job, &done->usage);
+
+    mark_jid(job_list, job->jid, 0);
+    if (job_list->plus_jid == job->jid) {
+        job_list->plus_jid = job_list->minus_jid;
+        job_list->minus_jid = 0;
+    } else if (job_list->minus_jid == job->jid) {
+        job_list->minus_jid = 0;
+    }
+
+    job_element_t **link = &job_list->jid_table[jid_bucket(job_list, job->jid)];
+    while (*link != job) {
+        link = &(*link)->jid_chain;
+    }
+    *link = job->jid_chain;
+
+    for (job_process_t *proc = &job->leader; proc != NULL; proc = proc->next) {
+        if (proc == &job->leader || !proc->done) {
+            unindex_process(job_list, proc);
+        }
+    }
+
+    if (job->prev != NULL) {
+        job->prev->next = job->next;
+    } else {
+        job_list->head = job->next;
+    }
+    if (job->next != NULL) {
+        job->next->prev = job->prev;
+    } else {
+        job_list->tail = job->prev;
+    }
+    if (job_list->current == job) {
+        job_list->current = job->next;
+    }
+    job_list->count--;
+
+    free_job(job_list, job);
+}
+
 /* initializes job list, returns pointer */
 job_list_t *init_job_list() {
     job_list_t *job_list = (job_list_t *) malloc(sizeof(job_list_t));
     job_list->head = NULL;
+    job_list->tail = NULL;
     job_list->current = NULL;
+    job_list->nbuckets = _JOB_BUCKETS_INIT;
+    job_list->count = 0;
+    job_list->jid_table = calloc(job_list->nbuckets, sizeof(job_element_t *));
+    job_list->pid_table = calloc(job_list->nbuckets, sizeof(job_process_t *));
+    job_list->slabs = NULL;
+    job_list->free_jobs = NULL;
+    job_list->ndone = 0;
+    job_list->jid_words = _JOB_JID_WORDS_INIT;
+    job_list->jid_bits = calloc(job_list->jid_words, sizeof(uint64_t));
+    job_list->jid_full = calloc(job_list->jid_words / 64, sizeof(uint64_t));
+    job_list->plus_jid = 0;
+    job_list->minus_jid = 0;
+    mark_jid(job_list, 0, 1);
     job_list->shell_pid = getpid();
     return job_list;
 }
@@ -47,28 +516,46 @@ void cleanup_job_list(job_list_t *job_list) {
 	// if we are cleaning up the shell's job list and not a child's
 		if (getpid() == job_list->shell_pid) {
         /* kill process */
-        	if (kill(-cur->pid, SIGKILL) < 0) {
+        	if (send_job_signal(cur, SIGKILL) < 0) {
             	perror("kill");
         	}	
 		}
 
-        /* free strings */
-		if (cur->state != NULL) {
-        	free(cur->state);
-        	cur->state = NULL;
-    	}
-
-    	if (cur->command != NULL) {
-        	free(cur->command);
-        	cur->command = NULL;
-    	}
-
-        free(cur);
+        /* free the extra processes and the command if it did not fit in the record */
+        close_pidfd(&cur->leader);
+        job_process_t *proc = cur->leader.next;
+        while (proc != NULL) {
+            job_process_t *next_proc = proc->next;
+            close_pidfd(proc);
+            free(proc);
+            proc = next_proc;
+        }
+        if (cur->command != cur->command_buf) {
+            free(cur->command);
+        }
+        free(cur->launch);
+        cur->command = NULL;
         cur = nextElement;
     }
 
+    /* the records themselves go away with their slabs */
+    while (job_list->slabs != NULL) {
+        job_slab_t *next_slab = job_list->slabs->next;
+        free(job_list->slabs);
+        job_list->slabs = next_slab;
+    }
+    job_list->free_jobs = NULL;
+
+    free(job_list->jid_table);
+    free(job_list->pid_table);
+    free(job_list->jid_bits);
+    free(job_list->jid_full);
+    job_list->jid_table = NULL;
+    job_list->pid_table = NULL;
     job_list->head = NULL;
+    job_list->tail = NULL;
     job_list->current = NULL;
+    job_list->count = 0;
     job_list->shell_pid = 0;
 
     free(job_list);
@@ -77,191 +564,411 @@ void cleanup_job_list(job_list_t *job_list) {
 /* adds new job to list, returns 0 on success, -1 on failure */
 int add_job(job_list_t *job_list, int jid, pid_t pid, 
     process_state_t state, char *command) {
-    if (job_list == NULL || state == NULL || command == NULL) {
+    if (job_list == NULL || state == NULL || command == NULL || jid <= 0) {
         return -1;
     }
 
-    job_element_t *new = (job_element_t *) malloc(sizeof(job_element_t));
-    new->jid = jid;
-    new->pid = pid;
+    // keep the chains short, on failure we just carry on with longer chains
+    if (job_list->count >= job_list->nbuckets) {
+        grow_indexes(job_list);
+    }
 
-    // allocate new char*'s and copy buffers in to protect our code
-    size_t statelen = strlen(state);
-    new->state = (char *) malloc(sizeof(char) * (statelen + 1));
-    memcpy(new->state, state, statelen);
-    new->state[statelen] = 0;
+    state = intern_state(state);
+    if (state == NULL) {
+        return -1;
+    }
 
+    // copy the command in to protect our code, short commands (the common
+    // case) fit in the record so a job costs no allocation beyond its slab
     size_t cmdlen = strlen(command);
-    new->command = (char *) malloc(sizeof(char) * (cmdlen + 1));
+    char *cmd_copy = NULL;
+    if (cmdlen >= _JOB_CMD_INLINE) {
+        cmd_copy = (char *) malloc(sizeof(char) * (cmdlen + 1));
+        if (cmd_copy == NULL) {
+            return -1;
+        }
+    }
+    job_element_t *new = alloc_job(job_list);
+    if (new == NULL || mark_jid(job_list, jid, 1) == -1) {
+        if (new != NULL) {
+            new->next = job_list->free_jobs;
+            job_list->free_jobs = new;
+        }
+        free(cmd_copy);
+        return -1;
+    }
+    new->jid = jid;
+    new->running = 1;
+    new->foreground = 0;
+    new->leader.pid = pid;
+    new->leader.pidfd = -1;
+    new->leader.done = 0;
+    new->leader.status = 0;
+    new->leader.sig = 0;
+    memset(&new->leader.usage, 0, sizeof(job_usage_t));
+    new->leader.job = new;
+    new->leader.next = NULL;
+    new->state = state;
+    new->command = cmd_copy != NULL ? cmd_copy : new->command_buf;
+    new->launch = NULL;
     memcpy(new->command, command, cmdlen);
     new->command[cmdlen] = 0;
-    new->next = NULL;
 
-    if (job_list->head == NULL) {
-        // add to head
+    // add to tail, which we keep track of instead of walking to it
+    new->next = NULL;
+    new->prev = job_list->tail;
+    if (job_list->tail == NULL) {
         job_list->head = new;
         job_list->current = new;
     } else {
-        // add to tail
-        job_element_t *cur = job_list->head;
-        while (cur->next != NULL) {
-            cur = cur->next;
-        }
-        cur->next = new;
+        job_list->tail->next = new;
     }
-    // printf("job_list->head->pid = %d\n", job_list->head->pid);
+    job_list->tail = new;
+
+    index_job(job_list, new);
+    job_list->count++;
+    touch_job(job_list, jid);
     return 0;
 }
 
-/* removes job from list, given job's JID, 
-    returns 0 on success, -1 on failure */
-int remove_job_jid(job_list_t *job_list, int jid) {
+/* adds another process to a job, given job's JID, for jobs made up of
+    several processes such as pipelines, returns 0 on success, -1 on failure */
+int add_job_process(job_list_t *job_list, int jid, pid_t pid) {
     if (job_list == NULL) {
         return -1;
     }
 
-    job_element_t *prev = NULL;
-    job_element_t *cur = job_list->head;
-    while (cur != NULL) {
-        if (cur->jid == jid) {
-            if (prev != NULL) {
-                prev->next = cur->next;
-            }
-            if (job_list->head == cur) {
-                job_list->head = cur->next;
-            }
-            if (job_list->current == cur) {
-                job_list->current = cur->next;
-            }
+    job_element_t *job = find_job_jid(job_list, jid);
+    if (job == NULL) {
+        return -1;
+    }
+    job_process_t *proc = (job_process_t *) malloc(sizeof(job_process_t));
+    if (proc == NULL) {
+        return -1;
+    }
+    proc->pid = pid;
+    proc->pidfd = -1;
+    proc->done = 0;
+    proc->status = 0;
+    memset(&proc->usage, 0, sizeof(job_usage_t));
+    proc->job = job;
 
-            // free char*'s
-            if (cur->state != NULL) {
-                free(cur->state);
-                cur->state = NULL;
-            }
-            if (cur->command != NULL) {
-                free(cur->command);
-                cur->command = NULL;
-            }
+    // keep the processes in the order they were added in
+    job_process_t *last = &job->leader;
+    while (last->next != NULL) {
+        last = last->next;
+    }
+    proc->next = NULL;
+    last->next = proc;
+    job->running++;
+    index_process(job_list, proc);
+    return 0;
+}
 
-            free(cur);
-            cur = NULL;
+/* marks a process of a job as finished, given the process's PID,
+    returns how many processes of its job have not finished, -1 on failure */
+int finish_job_process(job_list_t *job_list, pid_t pid) {
+    if (job_list == NULL) {
+        return -1;
+    }
 
-            return 0;
+    job_process_t *proc = find_process(job_list, pid);
+    if (proc == NULL) {
+        return -1;
+    }
+    if (!proc->done) {
+        proc->done = 1;
+        proc->job->running--;
+        close_pidfd(proc);
+        // the leader's pid is the job's pid and stays in the index for as
+        // long as the job does, the kernel will not hand it out again while
+        // it names the process group of the other processes
+        if (proc != &proc->job->leader) {
+            unindex_process(job_list, proc);
         }
+    }
+    return proc->job->running;
+}
 
-        prev = cur;
-        cur = cur->next;
+/* records the resource usage of a process of a job, given the process's PID,
+    as reported when it stopped or finished, returns 0 on success, -1 on failure */
+int set_job_usage(job_list_t *job_list, pid_t pid, const struct rusage *usage) {
+    if (job_list == NULL || usage == NULL) {
+        return -1;
     }
 
-    return -1;
+    job_process_t *proc = find_process(job_list, pid);
+    if (proc == NULL) {
+        return -1;
+    }
+    proc->usage.utime = (long long) usage->ru_utime.tv_sec * 1000000 + usage->ru_utime.tv_usec;
+    proc->usage.stime = (long long) usage->ru_stime.tv_sec * 1000000 + usage->ru_stime.tv_usec;
+    proc->usage.maxrss = usage->ru_maxrss;
+    proc->usage.minflt = usage->ru_minflt;
+    proc->usage.majflt = usage->ru_majflt;
+    proc->usage.nvcsw = usage->ru_nvcsw;
+    proc->usage.nivcsw = usage->ru_nivcsw;
+    return 0;
 }
 
-/* removes job from list, given job's PID, 
+/* gets the resource usage of a job, given job's JID, added up over its
+    processes, from the last job with that JID if it has been removed,
     returns 0 on success, -1 on failure */
-int remove_job_pid(job_list_t *job_list, pid_t pid) {
+int get_job_usage(job_list_t *job_list, int jid, struct rusage *usage) {
+    if (job_list == NULL || usage == NULL) {
+        return -1;
+    }
+
+    job_usage_t sum;
+    job_element_t *job = find_job_jid(job_list, jid);
+    if (job != NULL) {
+        sum_job_usage(job, &sum);
+    } else {
+        // jids are reused, so the newest job with the jid is the one wanted
+        size_t kept = job_list->ndone < _JOB_DONE_KEEP ? job_list->ndone : _JOB_DONE_KEEP;
+        size_t i = 0;
+        while (i < kept && job_list->done[(job_list->ndone - 1 - i) % _JOB_DONE_KEEP].jid != jid) {
+            i++;
+        }
+        if (i == kept) {
+            return -1;
+        }
+        sum = job_list->done[(job_list->ndone - 1 - i) % _JOB_DONE_KEEP].usage;
+    }
+    memset(usage, 0, sizeof(struct rusage));
+    usage->ru_utime.tv_sec = (time_t) (sum.utime / 1000000);
+    usage->ru_utime.tv_usec = (suseconds_t) (sum.utime % 1000000);
+    usage->ru_stime.tv_sec = (time_t) (sum.stime / 1000000);
+    usage->ru_stime.tv_usec = (suseconds_t) (sum.stime % 1000000);
+    usage->ru_maxrss = sum.maxrss;
+    usage->ru_minflt = sum.minflt;
+    usage->ru_majflt = sum.majflt;
+    usage->ru_nvcsw = sum.nvcsw;
+    usage->ru_nivcsw = sum.nivcsw;
+    return 0;
+}
+
+/* records how a process of a job finished, given the process's PID,
+    returns 0 on success, -1 on failure */
+int set_job_status(job_list_t *job_list, pid_t pid, int status, int sig) {
     if (job_list == NULL) {
-        printf("is job list null?\n");
         return -1;
     }
 
-    job_element_t *prev = NULL;
-    job_element_t *cur = job_list->head;
-    while (cur != NULL) {
-        if (cur->pid == pid) {
-            if (prev != NULL) {
-                prev->next = cur->next;
-            }
-            if (job_list->head == cur) {
-                job_list->head = cur->next;
-            }
-            if (job_list->current == cur) {
-                job_list->current = cur->next;
-            }
+    job_process_t *proc = find_process(job_list, pid);
+    if (proc == NULL) {
+        return -1;
+    }
+    proc->status = status;
+    proc->sig = sig;
+    return 0;
+}
 
-            // free char*'s
-            if (cur->state != NULL) {
-                free(cur->state);
-                cur->state = NULL;
-            }
-            if (cur->command != NULL) {
-                free(cur->command);
-                cur->command = NULL;
-            }
-            free(cur);
-            cur = NULL;
+/* records whether the shell waits for a job, given job's JID,
+    returns 0 on success, -1 on failure */
+int set_job_foreground(job_list_t *job_list, int jid, int foreground) {
+    if (job_list == NULL) {
+        return -1;
+    }
 
-            return 0;
-        }
+    job_element_t *job = find_job_jid(job_list, jid);
+    if (job == NULL) {
+        return -1;
+    }
+    job->foreground = foreground;
+    return 0;
+}
 
-        prev = cur;
-        cur = cur->next;
+/* gets how a job finished, given job's JID, from the last job with that
+    JID if it has been removed, returns the status, -1 on failure */
+int get_job_status(job_list_t *job_list, int jid) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    job_element_t *job = find_job_jid(job_list, jid);
+    if (job != NULL) {
+        return last_process(job)->status;
+    }
+    size_t kept = job_list->ndone < _JOB_DONE_KEEP ? job_list->ndone : _JOB_DONE_KEEP;
+    for (size_t i = 0; i < kept; i++) {
+        job_done_t *done = &job_list->done[(job_list->ndone - 1 - i) % _JOB_DONE_KEEP];
+        if (done->jid == jid) {
+            return done->status;
+        }
     }
     return -1;
 }
 
-/* updates job's state, given job's JID, returns 0 on success, -1 on failure */
-int update_job_jid(job_list_t *job_list, int jid, process_state_t state) {
+/* sets the pidfd of a process of a job, given the process's PID, which the
+    job list closes once the process has finished or its job is removed,
+    returns 0 on success, -1 on failure */
+int set_job_pidfd(job_list_t *job_list, pid_t pid, int pidfd) {
     if (job_list == NULL) {
         return -1;
     }
 
-    job_element_t *cur = job_list->head;
-    while (cur != NULL) {
-        if (cur->jid == jid) {
-            // free char * and allocate new char * to protect our code
-            if (cur->state != NULL) {
-                free(cur->state);
-                cur->state = NULL;
+    job_process_t *proc = find_process(job_list, pid);
+    if (proc == NULL || proc->done) {
+        return -1;
+    }
+    close_pidfd(proc);
+    proc->pidfd = pidfd;
+    return 0;
+}
+
+/* records the settings a job was launched with, given job's JID */
+int set_job_launch(job_list_t *job_list, int jid, const char *launch) {
+    if (job_list == NULL || launch == NULL) {
+        return -1;
+    }
+
+    job_element_t *job = find_job_jid(job_list, jid);
+    if (job == NULL) {
+        return -1;
+    }
+    char *copy = strdup(launch);
+    if (copy == NULL) {
+        return -1;
+    }
+    free(job->launch);
+    job->launch = copy;
+    return 0;
+}
+
+/* gets the pidfd of a process of a job, given the process's PID,
+    returns the pidfd on success, -1 on failure */
+int get_job_pidfd(job_list_t *job_list, pid_t pid) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    job_process_t *proc = find_process(job_list, pid);
+    return proc != NULL ? proc->pidfd : -1;
+}
+
+/* gets the pidfds of the processes of a job that have not finished, given
+    job's JID, in the order the processes were added, storing at most max of
+    them in pidfds, returns how many there are on success, -1 on failure */
+int get_job_pidfds(job_list_t *job_list, int jid, int *pidfds, int max) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    job_element_t *job = find_job_jid(job_list, jid);
+    if (job == NULL) {
+        return -1;
+    }
+    int n = 0;
+    for (job_process_t *proc = &job->leader; proc != NULL; proc = proc->next) {
+        if (!proc->done) {
+            if (n < max) {
+                pidfds[n] = proc->pidfd;
             }
-            cur->state = (char *) malloc(sizeof(char) * (strlen(state) + 1));
-            memcpy(cur->state, state, strlen(state) + 1);
-            return 0;
+            n++;
         }
-        cur = cur->next;
     }
-    return -1;
+    return n;
 }
-/* updates job's state, given job's PID, returns 0 on success, -1 on failure */
-int update_job_pid(job_list_t *job_list, pid_t pid, process_state_t state) {
+
+/* gets the JIDs of the jobs in the list, storing at most max of them in
+    jids, returns how many there are on success, -1 on failure */
+int get_job_jids(job_list_t *job_list, int *jids, int max) {
     if (job_list == NULL) {
         return -1;
     }
 
-    job_element_t *cur = job_list->head;
-    while (cur != NULL) {
-        if (cur->pid == pid) {
-            // free char * and allocate new char * to protect our code
-            if (cur->state != NULL) {
-                free(cur->state);
-                cur->state = NULL;
-            }
-            cur->state = (char *) malloc(sizeof(char) * (strlen(state) + 1));
-            memcpy(cur->state, state, strlen(state) + 1);
-            return 0;
+    int n = 0;
+    for (job_element_t *cur = job_list->head; cur != NULL; cur = cur->next) {
+        if (n < max) {
+            jids[n] = cur->jid;
         }
-        cur = cur->next;
+        n++;
     }
+    return n;
+}
 
-    return -1;
+/* sends a signal to every process of a job that has not finished, given
+    job's JID, returns 0 on success, -1 on failure */
+int signal_job(job_list_t *job_list, int jid, int sig) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    job_element_t *job = find_job_jid(job_list, jid);
+    if (job == NULL) {
+        return -1;
+    }
+    return send_job_signal(job, sig);
 }
 
-/* gets PID of job, given job's JID, returns PID on success, -1 on failure */
-pid_t get_job_pid(job_list_t *job_list, int jid) {
+/* removes job from list, given job's JID, 
+    returns 0 on success, -1 on failure */
+int remove_job_jid(job_list_t *job_list, int jid) {
     if (job_list == NULL) {
         return -1;
     }
 
-    job_element_t *cur = job_list->head;
-    while (cur != NULL) {
-        if (cur->jid == jid) {
-            return cur->pid;
-        }
+    job_element_t *job = find_job_jid(job_list, jid);
+    if (job == NULL) {
+        return -1;
+    }
+    unlink_job(job_list, job);
+    return 0;
+}
 
-        cur = cur->next;
+/* removes job from list, given job's PID, 
+    returns 0 on success, -1 on failure */
+int remove_job_pid(job_list_t *job_list, pid_t pid) {
+    if (job_list == NULL) {
+        return -1;
     }
 
-    return -1;
+    job_element_t *job = find_job_pid(job_list, pid);
+    if (job == NULL) {
+        return -1;
+    }
+    unlink_job(job_list, job);
+    return 0;
+}
+
+/* updates job's state, given job's JID, returns 0 on success, -1 on failure */
+int update_job_jid(job_list_t *job_list, int jid, process_state_t state) {
+    if (job_list == NULL || state == NULL) {
+        return -1;
+    }
+
+    job_element_t *job = find_job_jid(job_list, jid);
+    if (job == NULL || (state = intern_state(state)) == NULL) {
+        return -1;
+    }
+    job->state = state;
+    touch_job(job_list, job->jid);
+    return 0;
+}
+/* updates job's state, given job's PID, returns 0 on success, -1 on failure */
+int update_job_pid(job_list_t *job_list, pid_t pid, process_state_t state) {
+    if (job_list == NULL || state == NULL) {
+        return -1;
+    }
+
+    job_element_t *job = find_job_pid(job_list, pid);
+    if (job == NULL || (state = intern_state(state)) == NULL) {
+        return -1;
+    }
+    job->state = state;
+    touch_job(job_list, job->jid);
+    return 0;
+}
+
+/* gets PID of job, given job's JID, returns PID on success, -1 on failure */
+pid_t get_job_pid(job_list_t *job_list, int jid) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    job_element_t *job = find_job_jid(job_list, jid);
+    return job != NULL ? job->leader.pid : -1;
 }
 
 /* gets JID of job, given job's PID, returns JID on success, -1 on failure */
@@ -270,15 +977,112 @@ int get_job_jid(job_list_t *job_list, pid_t pid) {
         return -1;
     }
 
-    job_element_t *cur = job_list->head;
-    while (cur != NULL) {
-        if (cur->pid == pid) {
-            return cur->jid;
+    job_element_t *job = find_job_pid(job_list, pid);
+    return job != NULL ? job->jid : -1;
+}
+
+/* gets state of job, given job's JID, returns state on success, NULL on failure */
+process_state_t get_job_state(job_list_t *job_list, int jid) {
+    if (job_list == NULL) {
+        return NULL;
+    }
+
+    job_element_t *job = find_job_jid(job_list, jid);
+    return job != NULL ? job->state : NULL;
+}
+
+/* gets the lowest JID no job has, returns it */
+int get_free_jid(job_list_t *job_list) {
+    size_t nfull = job_list->jid_words / 64;
+    for (size_t s = 0; s < nfull; s++) {
+        if (job_list->jid_full[s] != UINT64_MAX) {
+            size_t w = s * 64 + (size_t) __builtin_ctzll(~job_list->jid_full[s]);
+            return (int) (w * 64 + (size_t) __builtin_ctzll(~job_list->jid_bits[w]));
+        }
+    }
+    // every jid the bitmap has room for is taken, the next one grows it
+    return (int) (job_list->jid_words * 64);
+}
+
+/* finds the JID a job spec refers to, given the spec without its % */
+int find_job_spec(job_list_t *job_list, const char *spec) {
+    if (job_list == NULL || spec == NULL) {
+        return -1;
+    }
+
+    if (spec[0] >= '0' && spec[0] <= '9') {
+        char *end;
+        long jid = strtol(spec, &end, 10);
+        if (*end || jid > INT32_MAX || find_job_jid(job_list, (int) jid) == NULL) {
+            return -1;
         }
+        return (int) jid;
+    }
 
-        cur = cur->next;
+    // without a current or previous job, the newest jobs stand in for them
+    int plus = !strcmp(spec, "") || !strcmp(spec, "+") || !strcmp(spec, "%");
+    if (plus || !strcmp(spec, "-")) {
+        int current = job_list->plus_jid;
+        if (current == 0 && job_list->tail != NULL) {
+            current = job_list->tail->jid;
+        }
+        if (plus) {
+            return current != 0 ? current : -1;
+        }
+        if (job_list->minus_jid != 0) {
+            return job_list->minus_jid;
+        }
+        for (job_element_t *cur = job_list->tail; cur != NULL; cur = cur->prev) {
+            if (cur->jid != current) {
+                return cur->jid;
+            }
+        }
+        return -1;
     }
 
+    // a prefix of the command must pick out one job
+    size_t len = strlen(spec);
+    int jid = -1;
+    for (job_element_t *cur = job_list->head; cur != NULL; cur = cur->next) {
+        if (!strncmp(cur->command, spec, len)) {
+            if (jid != -1) {
+                return -2;
+            }
+            jid = cur->jid;
+        }
+    }
+    return jid;
+}
+
+/* finds the background job that finished most recently that a job spec
+    refers to, by JID or the start of its command, leaving out JIDs in use
+    again, returns the JID and puts how the job finished in status,
+    -1 if there is no such job */
+int find_done_job_spec(job_list_t *job_list, const char *spec, int *status) {
+    if (job_list == NULL || spec == NULL || spec[0] == '\0') {
+        return -1;
+    }
+
+    long jid = -1;
+    if (spec[0] >= '0' && spec[0] <= '9') {
+        char *end;
+        jid = strtol(spec, &end, 10);
+        if (*end || jid > INT32_MAX) {
+            return -1;
+        }
+    }
+    size_t len = strlen(spec);
+    size_t kept = job_list->ndone < _JOB_DONE_KEEP ? job_list->ndone : _JOB_DONE_KEEP;
+    for (size_t i = job_list->ndone; i > job_list->ndone - kept; i--) {
+        job_done_t *done = &job_list->done[(i - 1) % _JOB_DONE_KEEP];
+        if (done->foreground || find_job_jid(job_list, done->jid) != NULL) {
+            continue;
+        }
+        if (jid != -1 ? done->jid == jid : !strncmp(done->command, spec, len)) {
+            *status = done->status;
+            return done->jid;
+        }
+    }
     return -1;
 }
 
@@ -297,7 +1101,7 @@ pid_t get_next_pid(job_list_t *job_list) {      // circular iterator
         job_list->current = job_list->head;
         return -1;
     } else {
-        pid_t pid = job_list->current->pid;
+        pid_t pid = job_list->current->leader.pid;
         job_list->current = job_list->current->next;
         return pid;
     }
@@ -312,7 +1116,7 @@ void jobs(job_list_t *job_list) {
     job_element_t *cur = job_list->head;
     while (cur != NULL) {
         if (printf("[%d] (%d) %s %s\n",
-                cur->jid, cur->pid, cur->state, cur->command) < 0) {
+                cur->jid, cur->leader.pid, cur->state, cur->command) < 0) {
             // printf("inside jobs while error\n");
             // perror("printf");
             cleanup_job_list(job_list);
@@ -322,3 +1126,50 @@ void jobs(job_list_t *job_list) {
         cur = cur->next;
     }
 }
+
+/*
+ * jobs -l command, prints out the jobs list with the resource usage of every
+ * job, which for a job that is still running counts only the processes that
+ * have finished or stopped, followed by the background jobs that finished
+ * most recently, the last one with each JID not in use again
+ */
+void jobs_long(job_list_t *job_list) {
+    if (job_list == NULL) {
+        return;
+    }
+    job_usage_t usage;
+    for (job_element_t *cur = job_list->head; cur != NULL; cur = cur->next) {
+        sum_job_usage(cur, &usage);
+        if (printf("[%d] (%d) %s %s\n",
+                cur->jid, cur->leader.pid, cur->state, cur->command) < 0
+                || print_job_usage(&usage) < 0
+                || (cur->launch != NULL && printf("\trun %s\n", cur->launch) < 0)) {
+            cleanup_job_list(job_list);
+            exit(1);
+        }
+    }
+    size_t kept = job_list->ndone < _JOB_DONE_KEEP ? job_list->ndone : _JOB_DONE_KEEP;
+    for (size_t i = job_list->ndone - kept; i < job_list->ndone; i++) {
+        job_done_t *done = &job_list->done[i % _JOB_DONE_KEEP];
+        if (done->foreground || find_job_jid(job_list, done->jid) != NULL) {
+            continue;
+        }
+        // a background job that finished later with the same JID stands for it
+        size_t later = i + 1;
+        while (later < job_list->ndone
+                && (job_list->done[later % _JOB_DONE_KEEP].jid != done->jid
+                    || job_list->done[later % _JOB_DONE_KEEP].foreground)) {
+            later++;
+        }
+        if (later < job_list->ndone) {
+            continue;
+        }
+        char how[64];
+        format_done(done, how, sizeof(how));
+        if (printf("[%d] (%d) %s %s\n", done->jid, done->pid, how, done->command) < 0
+                || print_job_usage(&done->usage) < 0) {
+            cleanup_job_list(job_list);
+            exit(1);
+        }
+    }
+}
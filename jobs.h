@@ -3,6 +3,7 @@
 
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/resource.h>
 
 #define _STATE_RUNNING "Running"
 #define _STATE_STOPPED "Stopped"
@@ -23,6 +24,58 @@ void cleanup_job_list(job_list_t *job_list);
 int add_job(job_list_t *job_list, int jid, pid_t pid, 
 	process_state_t state, char *command);
 
+/* adds another process to a job, given job's JID, for jobs made up of
+	several processes such as pipelines, returns 0 on success, -1 on failure */
+int add_job_process(job_list_t *job_list, int jid, pid_t pid);
+/* marks a process of a job as finished, given the process's PID,
+	returns how many processes of its job have not finished, -1 on failure */
+int finish_job_process(job_list_t *job_list, pid_t pid);
+
+/* records the resource usage of a process of a job, given the process's PID,
+	as reported when it stopped or finished, returns 0 on success, -1 on failure */
+int set_job_usage(job_list_t *job_list, pid_t pid, const struct rusage *usage);
+/* gets the resource usage of a job, given job's JID, added up over its
+	processes, from the last job with that JID if it has been removed,
+	returns 0 on success, -1 on failure */
+int get_job_usage(job_list_t *job_list, int jid, struct rusage *usage);
+
+/* records how a process of a job finished, given the process's PID: its
+	exit status, or 128 plus the signal that terminated it, and that
+	signal in sig, 0 if it exited,
+	returns 0 on success, -1 on failure */
+int set_job_status(job_list_t *job_list, pid_t pid, int status, int sig);
+/* records whether the shell waits for a job, given job's JID, so that
+	jobs -l leaves out the foreground jobs once they finished,
+	returns 0 on success, -1 on failure */
+int set_job_foreground(job_list_t *job_list, int jid, int foreground);
+/* gets how a job finished, given job's JID, which is how its last process
+	did, from the last job with that JID if it has been removed,
+	returns the status on success, -1 on failure */
+int get_job_status(job_list_t *job_list, int jid);
+
+/* sets the pidfd of a process of a job, given the process's PID, which the
+	job list closes once the process has finished or its job is removed,
+	returns 0 on success, -1 on failure */
+int set_job_pidfd(job_list_t *job_list, pid_t pid, int pidfd);
+/* records the settings a job was launched with, as a description that
+	jobs -l prints, given job's JID, returns 0 on success, -1 on failure */
+int set_job_launch(job_list_t *job_list, int jid, const char *launch);
+
+/* gets the pidfd of a process of a job, given the process's PID,
+	returns the pidfd on success, -1 on failure */
+int get_job_pidfd(job_list_t *job_list, pid_t pid);
+/* gets the pidfds of the processes of a job that have not finished, given
+	job's JID, in the order the processes were added, storing at most max of
+	them in pidfds, returns how many there are on success, -1 on failure */
+int get_job_pidfds(job_list_t *job_list, int jid, int *pidfds, int max);
+/* gets the JIDs of the jobs in the list, in the order of the list, storing
+	at most max of them in jids, returns how many there are on success, -1
+	on failure */
+int get_job_jids(job_list_t *job_list, int *jids, int max);
+/* sends a signal to every process of a job that has not finished, given
+	job's JID, returns 0 on success, -1 on failure */
+int signal_job(job_list_t *job_list, int jid, int sig);
+
 /* removes job from list, given job's JID, 
 	returns 0 on success, -1 on failure */
 int remove_job_jid(job_list_t *job_list, int jid);
@@ -39,6 +92,24 @@ int update_job_pid(job_list_t *job_list, pid_t pid, process_state_t state);
 pid_t get_job_pid(job_list_t *job_list, int jid);
 /* gets JID of job, given job's PID, returns JID on success, -1 on failure */
 int get_job_jid(job_list_t *job_list, pid_t pid);
+/* gets state of job, given job's JID, returns state on success, NULL on failure */
+process_state_t get_job_state(job_list_t *job_list, int jid);
+
+/* gets the lowest JID no job has, for the next job to be added with,
+	returns the JID */
+int get_free_jid(job_list_t *job_list);
+/* finds the job a job spec refers to, given the spec without its %: a JID,
+	+ or % (or nothing) for the job most recently started, stopped or
+	resumed, - for the one before it, or the start of a job's command,
+	returns the JID on success, -1 if there is no such job, -2 if the
+	start of the command fits more than one job */
+int find_job_spec(job_list_t *job_list, const char *spec);
+/* finds the background job that finished most recently that a job spec
+	refers to, by JID or the start of its command, for jobs that are
+	no longer in the list, leaving out JIDs in use again,
+	returns the JID and puts how the job finished in status,
+	-1 if there is no such job */
+int find_done_job_spec(job_list_t *job_list, const char *spec, int *status);
 
 /* 
  * gets next PID in list
@@ -50,5 +121,9 @@ pid_t get_next_pid(job_list_t *job_list);
 
 /* jobs command, prints out the jobs list */
 void jobs(job_list_t *job_list);
+/* jobs -l command, prints out the jobs list with the resource usage of
+	every job, followed by the background jobs that finished most recently,
+	with how they finished, the last one with each JID not in use again */
+void jobs_long(job_list_t *job_list);
 
 #endif  // JOBS_H_
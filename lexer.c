@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "./lexer.h"
+
+// 0x01 in every byte of a word, subtracted in the zero byte test and
+// multiplied by a character to repeat it in every byte, and 0x80 in every
+// byte, the top bits that test leaves set, for eight characters at once
+#define _ONES ((uint64_t) 0x0101010101010101ULL)
+#define _HIGHS ((uint64_t) 0x8080808080808080ULL)
+
+// the arena is a list of blocks, the ones in use up to current and the
+// ones kept from longer lines after it, used is how much of current is
+// handed out
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    char data[];
+};
+typedef struct arena_block arena_block_t;
+
+struct parse_arena {
+    arena_block_t *first;
+    arena_block_t *current;
+    size_t used;
+};
+
+/* returns a word with the top bit set in every byte of x that is zero */
+static uint64_t zero_bytes(uint64_t x) {
+    return (x - _ONES) & ~x & _HIGHS;
+}
+
+/*
+ * returns a word with the top bit set in every byte of x that ends a word:
+ * whitespace, an operator or the null character. The top bit can also be
+ * set for a byte above one that matched, so only the lowest one counts
+ */
+static uint64_t special_bytes(uint64_t x) {
+    return zero_bytes(x)
+        | zero_bytes(x ^ (_ONES * ' '))
+        | zero_bytes(x ^ (_ONES * '\t'))
+        | zero_bytes(x ^ (_ONES * '\n'))
+        | zero_bytes(x ^ (_ONES * '<'))
+        | zero_bytes(x ^ (_ONES * '>'))
+        | zero_bytes(x ^ (_ONES * '&'))
+        | zero_bytes(x ^ (_ONES * '|'))
+        | zero_bytes(x ^ (_ONES * ';'));
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+static int is_special(char c) {
+    return c == 0 || is_space(c) || c == '<' || c == '>' || c == '&' || c == '|' || c == ';';
+}
+
+/*
+ * finds the end of a word, eight characters at a time for as long as
+ * eight are left and then one at a time
+ */
+static const char *scan_word(const char *pos, const char *end) {
+    while (end - pos >= 8) {
+        uint64_t x;
+        memcpy(&x, pos, 8);
+        uint64_t found = special_bytes(x);
+        if (found) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            // the lowest byte in memory is the lowest one in the word
+            return pos + (__builtin_ctzll(found) >> 3);
+#else
+            // the bytes that can be set by mistake come first in memory
+            // here, so the byte is found one at a time below
+            break;
+#endif
+        }
+        pos += 8;
+    }
+    while (pos < end && !is_special(*pos)) {
+        pos++;
+    }
+    return pos;
+}
+
+/*
+ * reads the operator at pos, if there is one, moving pos past it
+ * returns the type of the operator, TOK_WORD if there is none
+ */
+static token_type_t scan_operator(lexer_t *lexer) {
+    const char *pos = lexer->pos;
+    switch (*pos) {
+    case '<':
+        if (pos + 1 < lexer->end && pos[1] == '<') {
+            if (pos + 2 < lexer->end && pos[2] == '<') {
+                lexer->pos += 3;
+                return TOK_HERESTRING;
+            }
+            lexer->pos += 2;
+            return TOK_HEREDOC;
+        }
+        lexer->pos++;
+        return TOK_IN;
+    case '>':
+        if (pos + 1 < lexer->end && pos[1] == '>') {
+            lexer->pos += 2;
+            return TOK_APPEND;
+        }
+        lexer->pos++;
+        return TOK_OUT;
+    case '&':
+        if (pos + 1 < lexer->end && pos[1] == '&') {
+            lexer->pos += 2;
+            return TOK_AND;
+        }
+        lexer->pos++;
+        return TOK_AMP;
+    case '|':
+        if (pos + 1 < lexer->end && pos[1] == '|') {
+            lexer->pos += 2;
+            return TOK_OR;
+        }
+        lexer->pos++;
+        return TOK_PIPE;
+    case ';':
+        lexer->pos++;
+        return TOK_SEMI;
+    default:
+        return TOK_WORD;
+    }
+}
+
+/* starts reading tokens from line, which is len characters long */
+void init_lexer(lexer_t *lexer, const char *line, size_t len) {
+    lexer->pos = line;
+    lexer->end = line + len;
+}
+
+/*
+ * reads the next token of the line into token
+ * returns the type of the token, TOK_END once the line is used up
+ */
+token_type_t next_token(lexer_t *lexer, token_t *token) {
+    while (lexer->pos < lexer->end && is_space(*lexer->pos)) {
+        lexer->pos++;
+    }
+    token->start = lexer->pos;
+    token->len = 0;
+    if (lexer->pos >= lexer->end || *lexer->pos == 0) {
+        token->type = TOK_END;
+        return TOK_END;
+    }
+    token->type = scan_operator(lexer);
+    if (token->type != TOK_WORD) {
+        return token->type;
+    }
+    const char *word_end = scan_word(lexer->pos, lexer->end);
+    token->len = (size_t) (word_end - token->start);
+    lexer->pos = word_end;
+    return TOK_WORD;
+}
+
+/* initializes an arena, returns pointer, NULL on failure */
+parse_arena_t *init_parse_arena() {
+    parse_arena_t *arena = (parse_arena_t *) malloc(sizeof(parse_arena_t));
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->first = (arena_block_t *) malloc(sizeof(arena_block_t) + _ARENA_BLOCK_LEN);
+    if (arena->first == NULL) {
+        free(arena);
+        return NULL;
+    }
+    arena->first->next = NULL;
+    arena->first->size = _ARENA_BLOCK_LEN;
+    arena->current = arena->first;
+    arena->used = 0;
+    return arena;
+}
+
+/*
+ * cleans up the arena
+ * Note: this function will free the arena pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_parse_arena(parse_arena_t *arena) {
+    if (arena == NULL) {
+        return;
+    }
+    arena_block_t *block = arena->first;
+    while (block != NULL) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+/*
+ * hands out size bytes that stay valid until the arena is reset
+ * returns pointer, NULL on failure
+ */
+void *arena_alloc(parse_arena_t *arena, size_t size) {
+    // everything handed out is aligned for pointers
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    while (arena->current->size - arena->used < size) {
+        arena_block_t *next = arena->current->next;
+        if (next == NULL) {
+            // a block too small for this is still kept, for smaller lines
+            size_t block_size = arena->current->size * 2;
+            if (block_size < size) {
+                block_size = size;
+            }
+            next = (arena_block_t *) malloc(sizeof(arena_block_t) + block_size);
+            if (next == NULL) {
+                return NULL;
+            }
+            next->next = NULL;
+            next->size = block_size;
+            arena->current->next = next;
+        }
+        arena->current = next;
+        arena->used = 0;
+    }
+    void *ptr = arena->current->data + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+/* takes back everything the arena handed out, keeping its blocks */
+void reset_parse_arena(parse_arena_t *arena) {
+    arena->current = arena->first;
+    arena->used = 0;
+}
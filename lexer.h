@@ -0,0 +1,72 @@
+#ifndef LEXER_H_
+#define LEXER_H_
+
+#include <unistd.h>
+#include <sys/types.h>
+
+// size of the first block of a parse arena, blocks after that are at least
+// as large as the one before
+#define _ARENA_BLOCK_LEN 16384
+
+// the kinds of tokens a line is made of
+typedef enum token_type {
+    TOK_END,        // the end of the line
+    TOK_WORD,       // anything else, up to whitespace or one of the others
+    TOK_IN,         // <
+    TOK_OUT,        // >
+    TOK_APPEND,     // >>
+    TOK_HEREDOC,    // <<
+    TOK_HERESTRING, // <<<
+    TOK_AMP,        // &
+    TOK_PIPE,       // |
+    TOK_AND,        // &&
+    TOK_OR,         // ||
+    TOK_SEMI        // ;
+} token_type_t;
+
+// a token is a slice of the line it was read from, which is neither copied
+// nor changed, so a word has to be copied to be null terminated
+typedef struct token {
+    token_type_t type;
+    const char *start;
+    size_t len;
+} token_t;
+
+// pos is where the next token starts and end is the end of the line
+typedef struct lexer {
+    const char *pos;
+    const char *end;
+} lexer_t;
+
+typedef struct parse_arena parse_arena_t;
+
+/* starts reading tokens from line, which is len characters long */
+void init_lexer(lexer_t *lexer, const char *line, size_t len);
+
+/*
+ * reads the next token of the line into token. Whitespace separates
+ * tokens, and so does every operator, so a>b is three tokens
+ * returns the type of the token, TOK_END once the line is used up
+ */
+token_type_t next_token(lexer_t *lexer, token_t *token);
+
+/* initializes an arena, returns pointer, NULL on failure */
+parse_arena_t *init_parse_arena();
+/*
+ * cleans up the arena
+ * Note: this function will free the arena pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_parse_arena(parse_arena_t *arena);
+
+/*
+ * hands out size bytes that stay valid until the arena is reset. Memory
+ * is only allocated when the blocks the arena already has are used up,
+ * which after the first few lines is hardly ever
+ * returns pointer, NULL on failure
+ */
+void *arena_alloc(parse_arena_t *arena, size_t size);
+/* takes back everything the arena handed out, keeping its blocks */
+void reset_parse_arena(parse_arena_t *arena);
+
+#endif  // LEXER_H_
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "./pathcache.h"
+
+// number of buckets in the name index, must be a power of two
+#define _PATH_BUCKETS 256
+
+// a directory of PATH as it looked when it was last checked
+struct path_dir {
+    char *name;
+    struct timespec mtime;
+    struct timespec checked;
+};
+typedef struct path_dir path_dir_t;
+
+// a remembered command: the name it was looked up by, where it was found,
+// the index in dirs of the directory it was found in and the epoch of the
+// cache at that time
+struct path_entry {
+    char *name;
+    char *path;
+    size_t dir;
+    unsigned long epoch;
+    unsigned long hits;
+    struct path_entry *chain;
+};
+typedef struct path_entry path_entry_t;
+
+// path is the value of PATH that dirs was split from
+// epoch is bumped every time a directory is seen to have changed, which
+// makes every entry found before then stale
+struct path_cache {
+    char *path;
+    path_dir_t *dirs;
+    size_t ndirs;
+    unsigned long epoch;
+    path_entry_t *table[_PATH_BUCKETS];
+};
+
+/* bucket of a command name, FNV-1a */
+static size_t name_bucket(const char *name) {
+    unsigned int h = 2166136261u;
+    for (; *name; name++) {
+        h = (h ^ (unsigned char) *name) * 16777619u;
+    }
+    return (size_t) h & (_PATH_BUCKETS - 1);
+}
+
+/* reads a clock that does not cost a system call */
+static struct timespec coarse_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return now;
+}
+
+/* frees the directories PATH was split into */
+static void free_dirs(path_cache_t *cache) {
+    for (size_t i = 0; i < cache->ndirs; i++) {
+        free(cache->dirs[i].name);
+    }
+    free(cache->dirs);
+    free(cache->path);
+    cache->dirs = NULL;
+    cache->ndirs = 0;
+    cache->path = NULL;
+}
+
+/*
+ * splits PATH into its directories if it changed since the last call,
+ * forgetting every remembered location in that case
+ * returns 0 on success, -1 on failure
+ */
+static int load_path(path_cache_t *cache) {
+    const char *path = getenv("PATH");
+    if (path == NULL) {
+        path = "/usr/local/bin:/usr/bin:/bin";
+    }
+    if (cache->path != NULL && !strcmp(cache->path, path)) {
+        return 0;
+    }
+    clear_path_cache(cache);
+    free_dirs(cache);
+
+    size_t ndirs = 1;
+    for (const char *c = path; *c; c++) {
+        ndirs += *c == ':';
+    }
+    cache->path = strdup(path);
+    cache->dirs = (path_dir_t *) calloc(ndirs, sizeof(path_dir_t));
+    if (cache->path == NULL || cache->dirs == NULL) {
+        free_dirs(cache);
+        return -1;
+    }
+    const char *begin = path;
+    for (size_t i = 0; i < ndirs; i++) {
+        const char *end = strchrnul(begin, ':');
+        // an empty entry in PATH means the current directory
+        cache->dirs[i].name = end == begin ? strdup(".")
+            : strndup(begin, (size_t) (end - begin));
+        if (cache->dirs[i].name == NULL) {
+            cache->ndirs = i;
+            free_dirs(cache);
+            return -1;
+        }
+        begin = end + 1;
+    }
+    cache->ndirs = ndirs;
+    return 0;
+}
+
+/*
+ * stats the first upto + 1 directories of PATH if they have not been
+ * checked recently, bumping the epoch if any of them changed
+ */
+static void check_dirs(path_cache_t *cache, size_t upto) {
+    struct timespec now = coarse_now();
+    for (size_t i = 0; i <= upto && i < cache->ndirs; i++) {
+        path_dir_t *dir = &cache->dirs[i];
+        long age = (now.tv_sec - dir->checked.tv_sec) * 1000000000L
+            + (now.tv_nsec - dir->checked.tv_nsec);
+        if ((dir->checked.tv_sec || dir->checked.tv_nsec)
+                && age < _PATH_RECHECK_NS) {
+            continue;
+        }
+        struct stat st;
+        struct timespec mtime = {0, 0};
+        if (stat(dir->name, &st) == 0) {
+            mtime = st.st_mtim;
+        }
+        if (mtime.tv_sec != dir->mtime.tv_sec
+                || mtime.tv_nsec != dir->mtime.tv_nsec) {
+            dir->mtime = mtime;
+            cache->epoch++;
+        }
+        dir->checked = now;
+    }
+}
+
+/* initializes the command location cache, returns pointer */
+path_cache_t *init_path_cache() {
+    path_cache_t *cache = (path_cache_t *) calloc(1, sizeof(path_cache_t));
+    return cache;
+}
+
+/*
+ * cleans up the cache
+ * Note: this function will free the cache pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_path_cache(path_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    clear_path_cache(cache);
+    free_dirs(cache);
+    free(cache);
+}
+
+/* forgets every remembered location */
+void clear_path_cache(path_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    // locations kept elsewhere are not right anymore either
+    cache->epoch++;
+    for (size_t b = 0; b < _PATH_BUCKETS; b++) {
+        path_entry_t *cur = cache->table[b];
+        while (cur != NULL) {
+            path_entry_t *next = cur->chain;
+            free(cur->name);
+            free(cur->path);
+            free(cur);
+            cur = next;
+        }
+        cache->table[b] = NULL;
+    }
+}
+
+/*
+ * finds the executable a command name refers to. Names containing a '/'
+ * are returned as they are, anything else is searched for in PATH and
+ * remembered, so looking the same name up again costs no system calls
+ * until one of the PATH directories it depends on changes.
+ * returns the path, which stays valid until the next call, or NULL if
+ * the command could not be found
+ */
+const char *resolve_command(path_cache_t *cache, const char *name) {
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+    if (cache == NULL || *name == 0 || load_path(cache) == -1) {
+        return NULL;
+    }
+
+    size_t b = name_bucket(name);
+    path_entry_t **link = &cache->table[b];
+    while (*link != NULL && strcmp((*link)->name, name)) {
+        link = &(*link)->chain;
+    }
+    path_entry_t *entry = *link;
+    if (entry != NULL) {
+        // the location is still right unless its own directory or one that
+        // comes before it in PATH (and could now shadow it) has changed
+        check_dirs(cache, entry->dir);
+        if (entry->epoch == cache->epoch) {
+            entry->hits++;
+            return entry->path;
+        }
+        *link = entry->chain;
+        free(entry->name);
+        free(entry->path);
+        free(entry);
+    }
+
+    // search PATH from the front
+    check_dirs(cache, cache->ndirs);
+    size_t namelen = strlen(name);
+    for (size_t i = 0; i < cache->ndirs; i++) {
+        size_t dirlen = strlen(cache->dirs[i].name);
+        char *path = (char *) malloc(dirlen + namelen + 2);
+        if (path == NULL) {
+            return NULL;
+        }
+        memcpy(path, cache->dirs[i].name, dirlen);
+        path[dirlen] = '/';
+        memcpy(path + dirlen + 1, name, namelen + 1);
+
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)
+                && (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH))) {
+            entry = (path_entry_t *) malloc(sizeof(path_entry_t));
+            if (entry == NULL || (entry->name = strdup(name)) == NULL) {
+                free(entry);
+                free(path);
+                return NULL;
+            }
+            entry->path = path;
+            entry->dir = i;
+            entry->epoch = cache->epoch;
+            entry->hits = 1;
+            entry->chain = cache->table[b];
+            cache->table[b] = entry;
+            return entry->path;
+        }
+        free(path);
+    }
+    return NULL;
+}
+
+/* gets the epoch of the cache, after checking PATH and its directories */
+unsigned long path_cache_epoch(path_cache_t *cache) {
+    if (cache == NULL || load_path(cache) == -1) {
+        return 0;
+    }
+    check_dirs(cache, cache->ndirs);
+    return cache->epoch;
+}
+
+/* hash command, prints out the remembered locations and their hits */
+void print_path_cache(path_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    int empty = 1;
+    for (size_t b = 0; b < _PATH_BUCKETS; b++) {
+        for (path_entry_t *cur = cache->table[b]; cur != NULL; cur = cur->chain) {
+            if (empty) {
+                printf("hits\tcommand\n");
+                empty = 0;
+            }
+            printf("%4lu\t%s\n", cur->hits, cur->path);
+        }
+    }
+    if (empty) {
+        printf("hash: hash table empty\n");
+    }
+}
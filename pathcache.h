@@ -0,0 +1,47 @@
+#ifndef PATHCACHE_H_
+#define PATHCACHE_H_
+
+#include <unistd.h>
+#include <sys/types.h>
+
+// how often, in nanoseconds, a PATH directory is stat'ed to see whether
+// commands were added to or removed from it
+#define _PATH_RECHECK_NS 1000000000L
+
+typedef struct path_cache path_cache_t;
+
+/* initializes the command location cache, returns pointer */
+path_cache_t *init_path_cache();
+/*
+ * cleans up the cache
+ * Note: this function will free the cache pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_path_cache(path_cache_t *cache);
+
+/*
+ * finds the executable a command name refers to. Names containing a '/'
+ * are returned as they are, anything else is searched for in PATH and
+ * remembered, so looking the same name up again costs no system calls
+ * until one of the PATH directories it depends on changes.
+ * returns the path, which stays valid until the next call, or NULL if
+ * the command could not be found
+ */
+const char *resolve_command(path_cache_t *cache, const char *name);
+
+/*
+ * gets the epoch of the cache, which changes whenever a location it found
+ * may have become wrong: PATH changed, a directory of PATH was seen to have
+ * changed, or the cache was cleared. Directories not checked recently are
+ * checked first, as when looking a command up
+ * returns the epoch, which a location found while it lasts is right for
+ */
+unsigned long path_cache_epoch(path_cache_t *cache);
+
+/* forgets every remembered location */
+void clear_path_cache(path_cache_t *cache);
+
+/* hash command, prints out the remembered locations and their hits */
+void print_path_cache(path_cache_t *cache);
+
+#endif  // PATHCACHE_H_
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "./plancache.h"
+
+// number of buckets in the hash index, must be a power of two
+#define _PLAN_BUCKETS 128
+
+// a remembered line and its plans, all in one allocation: the entry, the
+// plans, the pointer arrays of the plans, the line as it was typed and the
+// copy of the words the plans point into. prev/next keep the entries in the order they were
+// last used, most recent first, and chain links an entry into its bucket
+// held counts the callers using the plan, stale is set for an entry that
+// was dropped from the cache while held, which is freed once released
+// paths are the locations of the commands of every plan, npaths of them,
+// each plan's at the same offset as its stages
+struct plan_entry {
+    uint64_t hash;
+    size_t len;
+    int held;
+    int stale;
+    char *line;
+    char **paths;
+    size_t npaths;
+    struct plan_entry *prev;
+    struct plan_entry *next;
+    struct plan_entry *chain;
+    plan_t plans[];
+};
+typedef struct plan_entry plan_entry_t;
+
+struct plan_cache {
+    plan_entry_t *table[_PLAN_BUCKETS];
+    plan_entry_t *head;
+    plan_entry_t *tail;
+    size_t count;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+/* the entry a plan handed out belongs to, the plans are its last member */
+static plan_entry_t *plan_entry(plan_t *plan) {
+    return (plan_entry_t *) (void *) ((char *) plan - offsetof(plan_entry_t, plans));
+}
+
+/* takes an entry off the recency list */
+static void unlink_recent(plan_cache_t *cache, plan_entry_t *entry) {
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+}
+
+/* puts an entry at the front of the recency list */
+static void push_recent(plan_cache_t *cache, plan_entry_t *entry) {
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev = entry;
+    } else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+/* frees an entry and the locations its plans keep */
+static void free_entry(plan_entry_t *entry) {
+    for (size_t i = 0; i < entry->npaths; i++) {
+        free(entry->paths[i]);
+    }
+    free(entry);
+}
+
+/* drops an entry from the cache, freeing it unless it is held */
+static void drop_entry(plan_cache_t *cache, plan_entry_t *entry) {
+    plan_entry_t **link = &cache->table[entry->hash & (_PLAN_BUCKETS - 1)];
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+    unlink_recent(cache, entry);
+    cache->count--;
+    if (entry->held) {
+        entry->stale = 1;
+    } else {
+        free_entry(entry);
+    }
+}
+
+/* initializes the plan cache, returns pointer */
+plan_cache_t *init_plan_cache() {
+    plan_cache_t *cache = (plan_cache_t *) calloc(1, sizeof(plan_cache_t));
+    return cache;
+}
+
+/*
+ * cleans up the cache
+ * Note: this function will free the cache pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_plan_cache(plan_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    clear_plan_cache(cache);
+    free(cache);
+}
+
+/* returns the hash a line is looked up by, FNV-1a */
+uint64_t hash_line(const char *line, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char) line[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/*
+ * finds the plan of a line and counts a hit or a miss
+ * returns the plan, NULL if there is none
+ */
+plan_t *find_plan(plan_cache_t *cache, const char *line, size_t len, uint64_t hash) {
+    if (cache == NULL) {
+        return NULL;
+    }
+    plan_entry_t *entry = cache->table[hash & (_PLAN_BUCKETS - 1)];
+    while (entry != NULL && (entry->hash != hash || entry->len != len
+            || memcmp(entry->line, line, len))) {
+        entry = entry->chain;
+    }
+    if (entry == NULL) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    unlink_recent(cache, entry);
+    push_recent(cache, entry);
+    entry->held++;
+    return entry->plans;
+}
+
+/* moves a pointer into parsed over to the same place in copy */
+static char *rebase(char *ptr, const char *parsed, size_t len, char *copy) {
+    if (ptr >= parsed && ptr <= parsed + len) {
+        return copy + (ptr - parsed);
+    }
+    // the redirection symbols are not part of the line
+    return ptr;
+}
+
+/*
+ * remembers a copy of a plan for a line
+ * returns the copy, NULL if the line is too long or on failure
+ */
+plan_t *add_plan(plan_cache_t *cache, const char *line, size_t len, uint64_t hash,
+    const plan_t *plan, const char *parsed) {
+    if (cache == NULL || len > _PLAN_MAX_LINE) {
+        return NULL;
+    }
+    // the stages are laid out one after the other, each ending in a null
+    // pointer, and so are the plans, so the arrays end at the null pointer
+    // ending the last stage of the last plan
+    int nplans = plan[0].nplans;
+    const plan_t *last_plan = &plan[nplans - 1];
+    size_t nwords = 0;
+    size_t nredirs = 0;
+    char **last = last_plan->cmd_args[last_plan->nstages - 1];
+    while (last[nwords] != 0) {
+        nwords++;
+    }
+    nwords += (size_t) (last - plan->cmd_args[0]) + 1;
+    last = last_plan->redir_args[last_plan->nstages - 1];
+    while (last[nredirs] != 0) {
+        nredirs++;
+    }
+    nredirs += (size_t) (last - plan->redir_args[0]) + 1;
+    size_t nstages = (size_t) (last_plan->cmd_args - plan->cmd_args) + (size_t) last_plan->nstages + 1;
+
+    size_t size = sizeof(plan_entry_t) + (size_t) nplans * sizeof(plan_t)
+        + (nwords + nredirs + nstages) * sizeof(char *) + 2 * nstages * sizeof(char **)
+        + 2 * (len + 1);
+    plan_entry_t *entry = (plan_entry_t *) malloc(size);
+    if (entry == NULL) {
+        return NULL;
+    }
+    char ***cmd_args = (char ***) (void *) (entry->plans + nplans);
+    char ***redir_args = cmd_args + nstages;
+    char **words = (char **) (void *) (redir_args + nstages);
+    char **redirs = words + nwords;
+    entry->paths = redirs + nredirs;
+    entry->npaths = nstages;
+    char *copy = (char *) (entry->paths + nstages);
+    entry->line = copy + len + 1;
+    memcpy(copy, parsed, len);
+    copy[len] = 0;
+    memcpy(entry->line, line, len);
+    entry->line[len] = 0;
+
+    for (size_t i = 0; i < nwords; i++) {
+        char *word = plan->cmd_args[0][i];
+        words[i] = word == NULL ? NULL : rebase(word, parsed, len, copy);
+    }
+    for (size_t i = 0; i < nredirs; i++) {
+        char *redir = plan->redir_args[0][i];
+        redirs[i] = redir == NULL ? NULL : rebase(redir, parsed, len, copy);
+    }
+    // the null pointers ending the stages of each plan are copied as well
+    for (size_t k = 0; k < nstages; k++) {
+        char **stage = plan->cmd_args[k];
+        cmd_args[k] = stage == NULL ? NULL : words + (stage - plan->cmd_args[0]);
+        stage = plan->redir_args[k];
+        redir_args[k] = stage == NULL ? NULL : redirs + (stage - plan->redir_args[0]);
+        entry->paths[k] = NULL;
+    }
+    for (int k = 0; k < nplans; k++) {
+        entry->plans[k] = plan[k];
+        entry->plans[k].cmd_args = cmd_args + (plan[k].cmd_args - plan->cmd_args);
+        entry->plans[k].redir_args = redir_args + (plan[k].redir_args - plan->redir_args);
+        entry->plans[k].paths = entry->paths + (plan[k].cmd_args - plan->cmd_args);
+        entry->plans[k].paths_epoch = 0;
+    }
+
+    // making room by forgetting the plan used least recently that is not held
+    if (cache->count >= _PLAN_CACHE_SIZE) {
+        plan_entry_t *victim = cache->tail;
+        while (victim != NULL && victim->held) {
+            victim = victim->prev;
+        }
+        if (victim != NULL) {
+            drop_entry(cache, victim);
+        }
+    }
+    entry->hash = hash;
+    entry->len = len;
+    entry->held = 1;
+    entry->stale = 0;
+    plan_entry_t **bucket = &cache->table[hash & (_PLAN_BUCKETS - 1)];
+    entry->chain = *bucket;
+    *bucket = entry;
+    push_recent(cache, entry);
+    cache->count++;
+    return entry->plans;
+}
+
+/* gives back a plan that was found or added */
+void release_plan(plan_cache_t *cache, plan_t *plan) {
+    (void) cache;
+    plan_entry_t *entry = plan_entry(plan);
+    entry->held--;
+    if (!entry->held && entry->stale) {
+        free_entry(entry);
+    }
+}
+
+/* forgets the locations kept in a plan if they are from another epoch */
+void check_plan_paths(plan_t *plan, unsigned long epoch) {
+    if (plan->paths == NULL || plan->paths_epoch == epoch) {
+        return;
+    }
+    for (int i = 0; i < plan->nstages; i++) {
+        free(plan->paths[i]);
+        plan->paths[i] = NULL;
+    }
+    plan->paths_epoch = epoch;
+}
+
+/* forgets every plan, except for the ones held, which go once released */
+void clear_plan_cache(plan_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    while (cache->head != NULL) {
+        drop_entry(cache, cache->head);
+    }
+}
+
+/* plans command, prints out how often lines were found and not found */
+void print_plan_cache(plan_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    printf("hits\tmisses\tplans\n%lu\t%lu\t%lu\n",
+        cache->hits, cache->misses, (unsigned long) cache->count);
+}
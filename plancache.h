@@ -0,0 +1,94 @@
+#ifndef PLANCACHE_H_
+#define PLANCACHE_H_
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "./runopts.h"
+
+// number of plans the cache holds before it forgets the least recently used
+#define _PLAN_CACHE_SIZE 64
+// lines longer than this are not worth keeping and are always parsed
+#define _PLAN_MAX_LINE 4096
+
+// how a plan follows the one before it on the line: whatever happened
+// (after ; or &, and for the first), only if it succeeded (&&) or only if
+// it failed (||)
+#define _PLAN_THEN 0
+#define _PLAN_AND 1
+#define _PLAN_OR 2
+
+// what a line is parsed into: the words and redirections of each stage of
+// its pipeline, laid out as parse lays them out, whether it ends with &,
+// whether it starts with time, which is then left out of the words, the
+// id of the built-in command it runs, -1 if it does not run one, and the
+// settings of a run prefix, which is left out of the words as well
+// a line of several pipelines has a plan for each, one after the other in
+// an array: op says how each follows the one before, and the first has the
+// number of them in nplans
+// a plan in the cache also keeps where the command of each stage was found
+// in paths, NULL for a stage not looked up yet, as of paths_epoch of the
+// location cache. paths is NULL for a plan that is not in the cache
+typedef struct plan {
+    int nstages;
+    int background;
+    int timed;
+    int builtin;
+    int op;
+    int nplans;
+    run_opts_t run;
+    char ***cmd_args;
+    char ***redir_args;
+    char **paths;
+    unsigned long paths_epoch;
+} plan_t;
+
+typedef struct plan_cache plan_cache_t;
+
+/* initializes the plan cache, returns pointer */
+plan_cache_t *init_plan_cache();
+/*
+ * cleans up the cache
+ * Note: this function will free the cache pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_plan_cache(plan_cache_t *cache);
+
+/* returns the hash a line is looked up by, FNV-1a */
+uint64_t hash_line(const char *line, size_t len);
+
+/*
+ * finds the plan of a line, given the line before it was parsed and its
+ * hash, and counts a hit or a miss. The plan found is held until it is
+ * released, and is never forgotten while it is held, so a line can be run
+ * from its plan while the lines it runs are looked up in turn
+ * returns the plan, NULL if there is none
+ */
+plan_t *find_plan(plan_cache_t *cache, const char *line, size_t len, uint64_t hash);
+/*
+ * remembers a copy of the plans of a line, given the line before it was
+ * parsed, its hash, the array of its plans, laid out by parse one after
+ * the other, and the len + 1 characters their words were copied into. The
+ * copy is held like a plan that was found
+ * returns the copy, NULL if the line is too long or on failure
+ */
+plan_t *add_plan(plan_cache_t *cache, const char *line, size_t len, uint64_t hash,
+    const plan_t *plan, const char *parsed);
+/*
+ * forgets the locations kept in a plan from the cache if they were found
+ * at an epoch of the location cache other than the one given, and takes
+ * that epoch for the ones found next, which are malloc'ed and freed with
+ * the plan
+ */
+void check_plan_paths(plan_t *plan, unsigned long epoch);
+
+/* gives back a plan that was found or added */
+void release_plan(plan_cache_t *cache, plan_t *plan);
+
+/* forgets every plan, except for the ones held, which go once released */
+void clear_plan_cache(plan_cache_t *cache);
+
+/* plans command, prints out how often lines were found and not found */
+void print_plan_cache(plan_cache_t *cache);
+
+#endif  // PLANCACHE_H_
@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "./reader.h"
+
+// buf holds cap bytes, of which the bytes between start and end have been
+// read but not yet returned as lines
+// scanned is how far past start we already know there is no newline, so
+// a long line that takes several reads is not searched over and over
+// a mapped reader has the whole file in buf (cap is the size of the
+// mapping) and starts out at end of file, so it never calls read()
+// wait, if set, is called before every read()
+struct line_reader {
+    int fd;
+    int mapped;
+    void (*wait)(int fd);
+    char *buf;
+    size_t cap;
+    size_t start;
+    size_t end;
+    size_t scanned;
+    int eof;
+};
+
+/* initializes a reader on the given file descriptor, returns pointer */
+line_reader_t *init_line_reader(int fd) {
+    line_reader_t *reader = (line_reader_t *) malloc(sizeof(line_reader_t));
+    if (reader == NULL) {
+        return NULL;
+    }
+    reader->buf = (char *) malloc(_READER_BUF_LEN);
+    if (reader->buf == NULL) {
+        free(reader);
+        return NULL;
+    }
+    reader->fd = fd;
+    reader->mapped = 0;
+    reader->wait = NULL;
+    reader->cap = _READER_BUF_LEN;
+    reader->start = 0;
+    reader->end = 0;
+    reader->scanned = 0;
+    reader->eof = 0;
+    return reader;
+}
+
+/*
+ * initializes a reader over the whole file at path, which is mapped into
+ * memory instead of read, so lines are handed out straight from the
+ * mapping without any system call. returns pointer, NULL on failure
+ */
+line_reader_t *init_line_reader_mmap(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t) st.st_size;
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    // lines are null terminated in place, which needs one byte past the
+    // end of the file for a last line without a newline. Reserving a
+    // private anonymous region one byte longer than the file and mapping
+    // the file over its start guarantees that byte exists, even when the
+    // file ends exactly on a page boundary
+    size_t cap = (size + 1 + page - 1) / page * page;
+    char *buf = mmap(NULL, cap, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (size > 0) {
+        // private, so writing the null characters never touches the file
+        if (mmap(buf, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                fd, 0) == MAP_FAILED) {
+            munmap(buf, cap);
+            close(fd);
+            return NULL;
+        }
+        // the script is walked front to back exactly once, so ask for
+        // aggressive read-ahead and start it right away, both are only hints
+        madvise(buf, size, MADV_SEQUENTIAL);
+        madvise(buf, size, MADV_WILLNEED);
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+
+    line_reader_t *reader = (line_reader_t *) malloc(sizeof(line_reader_t));
+    if (reader == NULL) {
+        munmap(buf, cap);
+        return NULL;
+    }
+    reader->fd = -1;
+    reader->mapped = 1;
+    reader->wait = NULL;
+    reader->buf = buf;
+    reader->cap = cap;
+    reader->start = 0;
+    reader->end = size;
+    reader->scanned = 0;
+    reader->eof = 1;
+    return reader;
+}
+
+/*
+ * cleans up the reader
+ * Note: this function will free the reader pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_line_reader(line_reader_t *reader) {
+    if (reader == NULL) {
+        return;
+    }
+    if (reader->mapped) {
+        munmap(reader->buf, reader->cap);
+    } else {
+        free(reader->buf);
+    }
+    reader->buf = NULL;
+    free(reader);
+}
+
+/*
+ * sets a function the reader calls, with its file descriptor, before every
+ * read() it makes. The function should return once the descriptor is
+ * readable and can do other work while it waits. By default the reader
+ * reads straight away
+ */
+void set_line_reader_wait(line_reader_t *reader, void (*wait)(int fd)) {
+    if (reader != NULL) {
+        reader->wait = wait;
+    }
+}
+
+/*
+ * makes room for at least one more large read after the unreturned bytes,
+ * first by sliding them to the front of the buffer and, if the line
+ * still does not leave enough room, by doubling the buffer
+ * returns 0 on success, -1 on failure
+ */
+static int make_room(line_reader_t *reader) {
+    if (reader->start > 0) {
+        memmove(reader->buf, reader->buf + reader->start,
+            reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    // one byte is always kept spare for the null character of the last line
+    if (reader->cap - reader->end < _READER_BUF_LEN / 2 + 1) {
+        char *buf = (char *) realloc(reader->buf, reader->cap * 2);
+        if (buf == NULL) {
+            return -1;
+        }
+        reader->buf = buf;
+        reader->cap *= 2;
+    }
+    return 0;
+}
+
+/*
+ * forgets that the end of the input was reached, so that the next call to
+ * read_line reads again. Does nothing for a reader over a mapped file
+ */
+void clear_line_reader_eof(line_reader_t *reader) {
+    if (!reader->mapped) {
+        reader->eof = 0;
+    }
+}
+
+/*
+ * reads the next line, without its newline, into *line and its length
+ * into *len. The line is null terminated and stays valid until the next
+ * call. A last line that is not terminated by a newline is still returned.
+ * returns 1 if a line was read, 0 at end of file, -1 on failure
+ */
+int read_line(line_reader_t *reader, char **line, size_t *len) {
+    for (;;) {
+        char *begin = reader->buf + reader->start;
+        char *nl = memchr(begin + reader->scanned, '\n',
+            reader->end - reader->start - reader->scanned);
+        if (nl != NULL) {
+            // a whole line is buffered, hand it out in place
+            *nl = 0;
+            *line = begin;
+            *len = (size_t) (nl - begin);
+            reader->start += *len + 1;
+            reader->scanned = 0;
+            return 1;
+        }
+        reader->scanned = reader->end - reader->start;
+
+        if (reader->eof) {
+            if (reader->start == reader->end) {
+                return 0;
+            }
+            // the input ended in the middle of a line
+            *len = reader->end - reader->start;
+            begin[*len] = 0;
+            *line = begin;
+            reader->start = reader->end;
+            reader->scanned = 0;
+            return 1;
+        }
+
+        if (make_room(reader) == -1) {
+            return -1;
+        }
+        if (reader->wait != NULL) {
+            reader->wait(reader->fd);
+        }
+        ssize_t n = read(reader->fd, reader->buf + reader->end,
+            reader->cap - reader->end - 1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        } else if (n == 0) {
+            reader->eof = 1;
+        } else {
+            reader->end += (size_t) n;
+        }
+    }
+}
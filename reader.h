@@ -0,0 +1,52 @@
+#ifndef READER_H_
+#define READER_H_
+
+#include <unistd.h>
+#include <sys/types.h>
+
+// size of the buffer a reader starts out with, the buffer is doubled
+// whenever a long line leaves less than half of this free for a read()
+#define _READER_BUF_LEN 65536
+
+typedef struct line_reader line_reader_t;
+
+/* initializes a reader on the given file descriptor, returns pointer */
+line_reader_t *init_line_reader(int fd);
+/*
+ * initializes a reader over the whole file at path, which is mapped into
+ * memory instead of read, so lines are handed out straight from the
+ * mapping without any system call. returns pointer, NULL on failure
+ */
+line_reader_t *init_line_reader_mmap(const char *path);
+/*
+ * cleans up the reader
+ * Note: this function will free the reader pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_line_reader(line_reader_t *reader);
+
+/*
+ * sets a function the reader calls, with its file descriptor, before every
+ * read() it makes. The function should return once the descriptor is
+ * readable and can do other work while it waits. By default the reader
+ * reads straight away
+ */
+void set_line_reader_wait(line_reader_t *reader, void (*wait)(int fd));
+
+/*
+ * forgets that the end of the input was reached, so that the next call to
+ * read_line reads again. A terminal reports end of file every time ^D is
+ * typed, and can still be read from afterwards. Does nothing for a reader
+ * over a mapped file
+ */
+void clear_line_reader_eof(line_reader_t *reader);
+
+/*
+ * reads the next line, without its newline, into *line and its length
+ * into *len. The line is null terminated and stays valid until the next
+ * call. A last line that is not terminated by a newline is still returned.
+ * returns 1 if a line was read, 0 at end of file, -1 on failure
+ */
+int read_line(line_reader_t *reader, char **line, size_t *len);
+
+#endif  // READER_H_
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include "./runopts.h"
+
+// ioprio_set has no wrapper in glibc, these are from linux/ioprio.h
+#define _IOPRIO_WHO_PROCESS 1
+#define _IOPRIO_CLASS_SHIFT 13
+#define _IOPRIO_LEVEL_DEFAULT 4
+
+// the I/O scheduling classes, at the index that is their number
+static const char *ionice_classes[] = { "none", "realtime", "best-effort", "idle" };
+// the suffixes of sizes, each 1024 times the one before
+static const char size_units[] = "KMGT";
+
+/* reads a list of cpus such as 0-3,6, returns 0 on success, -1 on failure */
+static int parse_cpus(const char *list, cpu_set_t *cpus) {
+    CPU_ZERO(cpus);
+    const char *p = list;
+    do {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+        if (last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET((size_t) cpu, cpus);
+        }
+        p = end;
+    } while (*p++ == ',');
+    return p[-1] == 0 ? 0 : -1;
+}
+
+/* reads an I/O class with an optional level, returns 0 on success, -1 on failure */
+static int parse_ionice(const char *value, int *ioprio) {
+    size_t len = strcspn(value, ":");
+    int class = -1;
+    for (int k = 1; k < 4; k++) {
+        if (strlen(ionice_classes[k]) == len && !strncmp(value, ionice_classes[k], len)) {
+            class = k;
+        }
+    }
+    if (class == -1) {
+        return -1;
+    }
+    int level = class == 3 ? 0 : _IOPRIO_LEVEL_DEFAULT;
+    if (value[len] == ':') {
+        char *end;
+        long l = strtol(value + len + 1, &end, 10);
+        if (end == value + len + 1 || *end || l < 0 || l > 7) {
+            return -1;
+        }
+        level = (int) l;
+    }
+    *ioprio = class << _IOPRIO_CLASS_SHIFT | level;
+    return 0;
+}
+
+/* reads a size with an optional K, M, G or T suffix, returns 0 on success, -1 on failure */
+static int parse_size(const char *value, rlim_t *size) {
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(value, &end, 10);
+    if (end == value || errno || value[0] == '-') {
+        return -1;
+    }
+    const char *suffix = end[0] ? strchr(size_units, end[0]) : NULL;
+    if (end[0] && (suffix == NULL || end[1])) {
+        return -1;
+    }
+    for (int shift = suffix != NULL ? (int) (suffix - size_units) + 1 : 0; shift > 0; shift--) {
+        if (n > (unsigned long long) RLIM_INFINITY / 1024) {
+            return -1;
+        }
+        n *= 1024;
+    }
+    *size = (rlim_t) n;
+    return 0;
+}
+
+/* reads the options after run in argv */
+int parse_run_opts(char **argv, run_opts_t *opts) {
+    static const char *names[] = { "--cpus", "--nice", "--ionice", "--rlimit-as" };
+    memset(opts, 0, sizeof(run_opts_t));
+    int i = 1;
+    while (argv[i] != NULL && !strncmp(argv[i], "--", 2)) {
+        if (argv[i][2] == 0) {
+            i++;
+            break;
+        }
+        int k = 0;
+        size_t len = strcspn(argv[i], "=");
+        while (k < 4 && (strlen(names[k]) != len || strncmp(argv[i], names[k], len))) {
+            k++;
+        }
+        if (k == 4) {
+            fprintf(stderr, "run: %s: unknown option\n", argv[i]);
+            return -1;
+        }
+        // the value is either after the = or the next word
+        const char *value = argv[i][len] == '=' ? argv[i] + len + 1 : argv[++i];
+        if (value == NULL) {
+            fprintf(stderr, "run: %s needs a value\n", names[k]);
+            return -1;
+        }
+        int bad = 0;
+        if (k == 0) {
+            bad = parse_cpus(value, &opts->cpus) == -1;
+        } else if (k == 1) {
+            char *end;
+            long nice = strtol(value, &end, 10);
+            bad = end == value || *end || nice < -20 || nice > 19;
+            opts->nice = (int) nice;
+        } else if (k == 2) {
+            bad = parse_ionice(value, &opts->ioprio) == -1;
+        } else {
+            bad = parse_size(value, &opts->rlimit_as) == -1;
+        }
+        if (bad) {
+            fprintf(stderr, "run: %s: invalid value for %s\n", value, names[k]);
+            return -1;
+        }
+        opts->flags |= 1 << k;
+        i++;
+    }
+    return i;
+}
+
+/* applies the settings to the calling process */
+int apply_run_opts(const run_opts_t *opts) {
+    if ((opts->flags & _RUN_CPUS) && sched_setaffinity(0, sizeof(cpu_set_t), &opts->cpus) == -1) {
+        perror("run: sched_setaffinity");
+        return -1;
+    }
+    if ((opts->flags & _RUN_NICE) && setpriority(PRIO_PROCESS, 0, opts->nice) == -1) {
+        perror("run: setpriority");
+        return -1;
+    }
+    if ((opts->flags & _RUN_IONICE)
+            && syscall(SYS_ioprio_set, _IOPRIO_WHO_PROCESS, 0, opts->ioprio) == -1) {
+        perror("run: ioprio_set");
+        return -1;
+    }
+    if (opts->flags & _RUN_RLIMIT_AS) {
+        struct rlimit lim;
+        if (getrlimit(RLIMIT_AS, &lim) == -1) {
+            perror("run: getrlimit");
+            return -1;
+        }
+        lim.rlim_cur = opts->rlimit_as;
+        if (lim.rlim_max != RLIM_INFINITY && lim.rlim_max < lim.rlim_cur) {
+            lim.rlim_cur = lim.rlim_max;
+        }
+        if (setrlimit(RLIMIT_AS, &lim) == -1) {
+            perror("run: setrlimit");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* writes a description of the settings into buf */
+void format_run_opts(const run_opts_t *opts, char *buf, size_t len) {
+    size_t n = 0;
+    buf[0] = 0;
+    if (opts->flags & _RUN_CPUS) {
+        n += (size_t) snprintf(buf + n, len - n, "--cpus ");
+        const char *sep = "";
+        for (int cpu = 0; cpu < CPU_SETSIZE && n < len; cpu++) {
+            if (!CPU_ISSET((size_t) cpu, &opts->cpus)) {
+                continue;
+            }
+            int last = cpu;
+            while (last + 1 < CPU_SETSIZE && CPU_ISSET((size_t) last + 1, &opts->cpus)) {
+                last++;
+            }
+            if (last > cpu) {
+                n += (size_t) snprintf(buf + n, len - n, "%s%d-%d", sep, cpu, last);
+            } else {
+                n += (size_t) snprintf(buf + n, len - n, "%s%d", sep, cpu);
+            }
+            sep = ",";
+            cpu = last;
+        }
+    }
+    if ((opts->flags & _RUN_NICE) && n < len) {
+        n += (size_t) snprintf(buf + n, len - n, "%s--nice %d", n ? " " : "", opts->nice);
+    }
+    if ((opts->flags & _RUN_IONICE) && n < len) {
+        int class = opts->ioprio >> _IOPRIO_CLASS_SHIFT;
+        n += (size_t) snprintf(buf + n, len - n, "%s--ionice %s:%d", n ? " " : "",
+            ionice_classes[class & 3], opts->ioprio & 7);
+    }
+    if ((opts->flags & _RUN_RLIMIT_AS) && n < len) {
+        unsigned long long size = (unsigned long long) opts->rlimit_as;
+        int unit = 0;
+        while (unit < 4 && size >= 1024 && size % 1024 == 0) {
+            size /= 1024;
+            unit++;
+        }
+        char suffix[2] = { unit ? size_units[unit - 1] : 0, 0 };
+        snprintf(buf + n, len - n, "%s--rlimit-as %llu%s", n ? " " : "", size, suffix);
+    }
+}
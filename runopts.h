@@ -0,0 +1,52 @@
+#ifndef RUNOPTS_H_
+#define RUNOPTS_H_
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+// which settings of a run prefix were given
+#define _RUN_CPUS 1
+#define _RUN_NICE 2
+#define _RUN_IONICE 4
+#define _RUN_RLIMIT_AS 8
+
+// longest description of the settings format_run_opts writes
+#define _RUN_DESC_LEN 128
+
+// the settings a job is launched with when its line starts with run:
+// the cpus its processes may run on, their nice value, their I/O priority
+// as ioprio_set takes it (class and level) and the most address space each
+// may have, in bytes. flags says which of them were given
+typedef struct run_opts {
+    int flags;
+    cpu_set_t cpus;
+    int nice;
+    int ioprio;
+    rlim_t rlimit_as;
+} run_opts_t;
+
+/*
+ * reads the options after run in argv, which starts with run:
+ *     --cpus LIST         cpus such as 0-3,6
+ *     --nice N            nice value, -20 to 19
+ *     --ionice CLASS[:N]  realtime, best-effort or idle, with a level 0-7
+ *     --rlimit-as SIZE    bytes, or with a K, M, G or T suffix
+ * each also as --option=value, up to the first word that is not an option
+ * or up to --. Prints a message if an option is not valid
+ * returns the number of words read, run included, -1 on failure
+ */
+int parse_run_opts(char **argv, run_opts_t *opts);
+
+/*
+ * applies the settings to the calling process, which is meant to be a
+ * child about to call execv, since they are inherited by the program
+ * returns 0 on success, -1 on failure, with errno set and a message printed
+ */
+int apply_run_opts(const run_opts_t *opts);
+
+/* writes a description of the settings into buf, as run takes them */
+void format_run_opts(const run_opts_t *opts, char *buf, size_t len);
+
+#endif  // RUNOPTS_H_
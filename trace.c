@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include "./trace.h"
+
+// events are collected in buf and written out whenever it fills up, the
+// trace's own system calls would otherwise show up in what it measures
+// the file belongs to the shell, children forked with a copy of the trace
+// never write to it, which owner is checked against
+struct trace {
+    int fd;
+    pid_t owner;
+    int first;
+    size_t len;
+    char buf[_TRACE_BUF_LEN];
+};
+
+/* writes out whatever is in the buffer */
+static void flush_trace(trace_t *trace) {
+    size_t done = 0;
+    while (done < trace->len) {
+        ssize_t n = write(trace->fd, trace->buf + done, trace->len - done);
+        if (n <= 0) {
+            // nothing to be done about it, the trace just misses events
+            break;
+        }
+        done += (size_t) n;
+    }
+    trace->len = 0;
+}
+
+/*
+ * starts a trace in the file at path, in the JSON format of Chrome's
+ * about:tracing and of Perfetto, returns pointer, NULL on failure
+ */
+trace_t *init_trace(const char *path) {
+    trace_t *trace = (trace_t *) malloc(sizeof(trace_t));
+    if (trace == NULL) {
+        return NULL;
+    }
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (trace->fd == -1) {
+        free(trace);
+        return NULL;
+    }
+    trace->owner = getpid();
+    trace->first = 1;
+    trace->len = (size_t) sprintf(trace->buf, "{\"traceEvents\":[");
+    return trace;
+}
+
+/*
+ * finishes the trace file and cleans up the trace
+ * Note: this function will free the trace pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_trace(trace_t *trace) {
+    if (trace == NULL) {
+        return;
+    }
+    if (getpid() == trace->owner) {
+        memcpy(trace->buf + trace->len, "\n],\"displayTimeUnit\":\"ns\"}\n", 27);
+        trace->len += 27;
+        flush_trace(trace);
+    }
+    close(trace->fd);
+    free(trace);
+}
+
+/*
+ * returns the time on CLOCK_MONOTONIC in nanoseconds, or 0 without a trace
+ */
+long long trace_now(trace_t *trace) {
+    if (trace == NULL) {
+        return 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * records a phase that ran from start to end in process tid, 0 for the
+ * shell itself, as a complete event, with its times in microseconds
+ */
+void trace_span(trace_t *trace, const char *name, pid_t tid,
+    long long start, long long end, const char *detail) {
+    if (trace == NULL || getpid() != trace->owner) {
+        return;
+    }
+    // room for the event with the longest detail it can carry, anything
+    // after that is cut off
+    if (_TRACE_BUF_LEN - trace->len < 1024) {
+        flush_trace(trace);
+    }
+    char *out = trace->buf + trace->len;
+    int n = sprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld.%03lld,"
+            "\"dur\":%lld.%03lld,\"pid\":%d,\"tid\":%d",
+            trace->first ? "" : ",", name, start / 1000, start % 1000,
+            (end - start) / 1000, (end - start) % 1000,
+            trace->owner, tid ? tid : trace->owner);
+    trace->first = 0;
+    if (detail != NULL) {
+        n += sprintf(out + n, ",\"args\":{\"cmd\":\"");
+        // the detail is a string in JSON, so quotes, backslashes and control
+        // characters have to be escaped
+        for (int i = 0; detail[i] && i < 128; i++) {
+            unsigned char c = (unsigned char) detail[i];
+            if (c == '"' || c == '\\') {
+                out[n++] = '\\';
+                out[n++] = (char) c;
+            } else if (c < 0x20) {
+                n += sprintf(out + n, "\\u%04x", c);
+            } else {
+                out[n++] = (char) c;
+            }
+        }
+        n += sprintf(out + n, "\"}");
+    }
+    out[n++] = '}';
+    trace->len += (size_t) n;
+}
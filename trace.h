@@ -0,0 +1,40 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <unistd.h>
+#include <sys/types.h>
+
+// size of the buffer events are collected in before they are written out
+#define _TRACE_BUF_LEN 65536
+
+typedef struct trace trace_t;
+
+/*
+ * starts a trace in the file at path, in the JSON format of Chrome's
+ * about:tracing and of Perfetto, returns pointer, NULL on failure
+ */
+trace_t *init_trace(const char *path);
+/*
+ * finishes the trace file and cleans up the trace
+ * Note: this function will free the trace pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_trace(trace_t *trace);
+
+/*
+ * returns the time on CLOCK_MONOTONIC in nanoseconds, which every process
+ * sees the same, or 0 without a trace, so that timing a phase costs
+ * nothing when tracing is off
+ */
+long long trace_now(trace_t *trace);
+
+/*
+ * records a phase that ran from start to end, as returned by trace_now,
+ * in process tid, 0 for the shell itself. detail, if not NULL, is shown
+ * with the phase, usually the command it was for. Does nothing without a
+ * trace
+ */
+void trace_span(trace_t *trace, const char *name, pid_t tid,
+    long long start, long long end, const char *detail);
+
+#endif  // TRACE_H_
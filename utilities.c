@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "./utilities.h"
+
+/* prints its arguments separated by spaces, with -n without the newline */
+int utility_echo(char **argv) {
+    int newline = 1;
+    int i = 1;
+    if (argv[i] != NULL && !strcmp(argv[i], "-n")) {
+        newline = 0;
+        i++;
+    }
+    for (int first = i; argv[i] != NULL; i++) {
+        if ((i > first && putchar(' ') == EOF) || fputs(argv[i], stdout) == EOF) {
+            return 1;
+        }
+    }
+    if (newline && putchar('\n') == EOF) {
+        return 1;
+    }
+    return 0;
+}
+
+/* returns 0 */
+int utility_true(char **argv) {
+    (void) argv;
+    return 0;
+}
+
+/* returns 1 */
+int utility_false(char **argv) {
+    (void) argv;
+    return 1;
+}
+
+/* prints the working directory */
+int utility_pwd(char **argv) {
+    (void) argv;
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        fprintf(stderr, "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    if (puts(cwd) == EOF) {
+        return 1;
+    }
+    return 0;
+}
+
+/* reads an integer operand of test, returns 0 on success, -1 if it is not one */
+static int test_integer(const char *word, long long *value) {
+    char *end;
+    errno = 0;
+    *value = strtoll(word, &end, 10);
+    if (end == word || *end || errno) {
+        fprintf(stderr, "test: %s: integer expression expected\n", word);
+        return -1;
+    }
+    return 0;
+}
+
+/* evaluates a unary test, returns 0 if it holds, 1 if not, 2 if op is not one */
+static int test_unary(const char *op, const char *arg) {
+    struct stat st;
+    if (op[0] != '-' || op[1] == 0 || op[2] != 0) {
+        fprintf(stderr, "test: %s: unary operator expected\n", op);
+        return 2;
+    }
+    switch (op[1]) {
+    case 'n':
+        return arg[0] == 0;
+    case 'z':
+        return arg[0] != 0;
+    case 'e':
+        return stat(arg, &st) == -1;
+    case 'f':
+        return stat(arg, &st) == -1 || !S_ISREG(st.st_mode);
+    case 'd':
+        return stat(arg, &st) == -1 || !S_ISDIR(st.st_mode);
+    case 's':
+        return stat(arg, &st) == -1 || st.st_size == 0;
+    case 'r':
+        return access(arg, R_OK) == -1;
+    case 'w':
+        return access(arg, W_OK) == -1;
+    case 'x':
+        return access(arg, X_OK) == -1;
+    }
+    fprintf(stderr, "test: %s: unary operator expected\n", op);
+    return 2;
+}
+
+/* evaluates a comparison, returns 0 if it holds, 1 if not, 2 if op is not one */
+static int test_binary(const char *left, const char *op, const char *right) {
+    if (!strcmp(op, "=") || !strcmp(op, "==")) {
+        return strcmp(left, right) != 0;
+    } else if (!strcmp(op, "!=")) {
+        return strcmp(left, right) == 0;
+    }
+    static const char *ops[] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+    for (int k = 0; k < 6; k++) {
+        if (strcmp(op, ops[k])) {
+            continue;
+        }
+        long long l, r;
+        if (test_integer(left, &l) == -1 || test_integer(right, &r) == -1) {
+            return 2;
+        }
+        int holds[] = { l == r, l != r, l < r, l <= r, l > r, l >= r };
+        return !holds[k];
+    }
+    fprintf(stderr, "test: %s: binary operator expected\n", op);
+    return 2;
+}
+
+/* evaluates the n words of a condition, returns as utility_test does */
+static int test_words(char **words, int n) {
+    int status;
+    switch (n) {
+    case 0:
+        return 1;
+    case 1:
+        return words[0][0] == 0;
+    case 2:
+        if (!strcmp(words[0], "!")) {
+            status = test_words(words + 1, 1);
+            return status == 2 ? 2 : !status;
+        }
+        return test_unary(words[0], words[1]);
+    case 3:
+        if (!strcmp(words[0], "!")) {
+            status = test_words(words + 1, 2);
+            return status == 2 ? 2 : !status;
+        }
+        return test_binary(words[0], words[1], words[2]);
+    case 4:
+        if (!strcmp(words[0], "!")) {
+            status = test_words(words + 1, 3);
+            return status == 2 ? 2 : !status;
+        }
+    }
+    fprintf(stderr, "test: too many arguments\n");
+    return 2;
+}
+
+/* evaluates a condition */
+int utility_test(char **argv) {
+    int n = 0;
+    while (argv[n + 1] != NULL) {
+        n++;
+    }
+    if (!strcmp(argv[0], "[")) {
+        if (n == 0 || strcmp(argv[n], "]")) {
+            fprintf(stderr, "[: missing ]\n");
+            return 2;
+        }
+        n--;
+    }
+    return test_words(argv + 1, n);
+}
+
+/*
+ * prints the character the escape sequence at s stands for, s being just
+ * past the backslash. In %b arguments, octal escapes start with 0
+ * returns the number of characters of the sequence, -1 for \c, which ends
+ * the output
+ */
+static int print_escape(const char *s, int in_arg) {
+    static const char from[] = "\\abfnrtv\"'";
+    static const char to[] = "\\\a\b\f\n\r\t\v\"'";
+    const char *c = *s ? strchr(from, *s) : NULL;
+    if (c != NULL) {
+        putchar(to[c - from]);
+        return 1;
+    }
+    if (*s == 'c') {
+        return -1;
+    }
+    int skip = in_arg && *s == '0';
+    if (s[skip] >= '0' && s[skip] <= '7') {
+        int value = 0;
+        int k = skip;
+        while (k < skip + 3 && s[k] >= '0' && s[k] <= '7') {
+            value = value * 8 + s[k++] - '0';
+        }
+        putchar(value);
+        return k;
+    }
+    putchar('\\');
+    return 0;
+}
+
+/* prints a string with its escape sequences, returns -1 if it had \c, 0 otherwise */
+static int print_escaped(const char *s) {
+    while (*s) {
+        if (*s != '\\') {
+            putchar(*s++);
+            continue;
+        }
+        int len = print_escape(++s, 1);
+        if (len == -1) {
+            return -1;
+        }
+        s += len;
+    }
+    return 0;
+}
+
+/* prints the arguments after the format as it says */
+int utility_printf(char **argv) {
+    if (argv[1] == NULL) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    const char *format = argv[1];
+    char **args = argv + 2;
+    int status = 0;
+    int used;
+    do {
+        used = 0;
+        for (const char *f = format; *f; ) {
+            if (*f == '\\') {
+                int len = print_escape(++f, 0);
+                if (len == -1) {
+                    goto done;
+                }
+                f += len;
+                continue;
+            } else if (*f != '%') {
+                putchar(*f++);
+                continue;
+            } else if (f[1] == '%') {
+                putchar('%');
+                f += 2;
+                continue;
+            }
+            // the flags, width and precision are handed on to printf as they are
+            char spec[32];
+            size_t len = strspn(f + 1, "-+ #0");
+            len += strspn(f + 1 + len, "0123456789");
+            if (f[1 + len] == '.') {
+                len += 1 + strspn(f + 2 + len, "0123456789");
+            }
+            char conv = f[1 + len];
+            if (conv == 0 || strchr("sbcdiuoxX", conv) == NULL || len + 5 > sizeof(spec)) {
+                fprintf(stderr, "printf: %.*s: invalid conversion\n", (int) len + 2, f);
+                status = 1;
+                goto done;
+            }
+            memcpy(spec, f, len + 1);
+            const char *arg = *args != NULL ? *args++ : "";
+            used++;
+            f += len + 2;
+            if (conv == 's') {
+                strcpy(spec + len + 1, "s");
+                printf(spec, arg);
+            } else if (conv == 'b') {
+                if (print_escaped(arg) == -1) {
+                    goto done;
+                }
+            } else if (conv == 'c') {
+                // an empty argument prints nothing but the padding
+                if (arg[0] == 0) {
+                    strcpy(spec + len + 1, "s");
+                    printf(spec, arg);
+                } else {
+                    strcpy(spec + len + 1, "c");
+                    printf(spec, arg[0]);
+                }
+            } else {
+                // an argument starting with a quote stands for the code of the
+                // character after it
+                long long value = 0;
+                if (arg[0] == '\'' || arg[0] == '"') {
+                    value = (unsigned char) arg[1];
+                } else if (arg[0]) {
+                    char *end;
+                    errno = 0;
+                    value = strtoll(arg, &end, 0);
+                    if (*end || errno) {
+                        fprintf(stderr, "printf: %s: invalid number\n", arg);
+                        status = 1;
+                    }
+                }
+                spec[len + 1] = 'l';
+                spec[len + 2] = 'l';
+                spec[len + 3] = conv == 'i' ? 'd' : conv;
+                spec[len + 4] = 0;
+                if (conv == 'd' || conv == 'i') {
+                    printf(spec, value);
+                } else {
+                    printf(spec, (unsigned long long) value);
+                }
+            }
+        }
+    } while (used > 0 && *args != NULL);
+done:
+    return status;
+}
+
+/* copies the file open on fd to stdout, returns 0 on success, -1 on failure */
+static int cat_fd(int fd, const char *name) {
+    static char buf[_CAT_BUF_LEN];
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n == 0) {
+            return 0;
+        } else if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            return -1;
+        }
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t w = write(STDOUT_FILENO, buf + off, (size_t) (n - off));
+            if (w == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fprintf(stderr, "cat: write error: %s\n", strerror(errno));
+                return -1;
+            }
+            off += w;
+        }
+    }
+}
+
+/* copies the files given, or stdin, to stdout */
+int utility_cat(char **argv) {
+    int reads_stdin = argv[1] == NULL;
+    for (int i = 1; argv[i] != NULL; i++) {
+        reads_stdin = reads_stdin || !strcmp(argv[i], "-");
+    }
+    if (reads_stdin && isatty(STDIN_FILENO)) {
+        return -1;
+    }
+    // whatever was printed before goes out first, and cat fails if it cannot
+    if (fflush(stdout) == EOF || ferror(stdout)) {
+        clearerr(stdout);
+        return 1;
+    }
+    if (argv[1] == NULL) {
+        return cat_fd(STDIN_FILENO, "-") == -1;
+    }
+    int status = 0;
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (!strcmp(argv[i], "-")) {
+            status |= cat_fd(STDIN_FILENO, "-") == -1;
+            continue;
+        }
+        int fd = open(argv[i], O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            fprintf(stderr, "cat: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        status |= cat_fd(fd, argv[i]) == -1;
+        close(fd);
+    }
+    return status;
+}
@@ -0,0 +1,51 @@
+#ifndef UTILITIES_H_
+#define UTILITIES_H_
+
+#include <unistd.h>
+#include <sys/types.h>
+
+// size of the buffer cat copies through
+#define _CAT_BUF_LEN 65536
+
+// Common utilities, run inside the shell instead of in a new process. Each
+// takes the words of the command, the name of the utility first, writes to
+// stdout and stderr like the program of the same name would and returns its
+// exit status. The shell sets up stdin and stdout for their redirections
+
+/* prints its arguments separated by spaces, with -n without the newline */
+int utility_echo(char **argv);
+
+/* returns 0 */
+int utility_true(char **argv);
+
+/* returns 1 */
+int utility_false(char **argv);
+
+/* prints the working directory */
+int utility_pwd(char **argv);
+
+/*
+ * evaluates a condition: a string on its own, a unary test of a file or
+ * string (-e -f -d -r -w -x -s -n -z) or a comparison of strings (= !=)
+ * or integers (-eq -ne -lt -le -gt -ge), possibly negated with !. Called
+ * as [, the last word must be ]
+ * returns 0 if it holds, 1 if not, 2 on a syntax error
+ */
+int utility_test(char **argv);
+
+/*
+ * prints the arguments after the format as it says, reusing it while there
+ * are arguments left. Knows the conversions %s %b %c %d %i %u %o %x %X and
+ * %% with flags, width and precision, and the escapes of the C language
+ */
+int utility_printf(char **argv);
+
+/*
+ * copies the files given, or stdin if there are none or for -, to stdout
+ * returns 0, 1 if a file could not be read, or -1 if it must read stdin
+ * and stdin is a terminal: the shell would not get SIGINT to interrupt it,
+ * so it is better run as a program
+ */
+int utility_cat(char **argv);
+
+#endif  // UTILITIES_H_